@@ -34,18 +34,188 @@ bool process_record_sm_td(uint16_t keycode, keyrecord_t* record) {
 
 #ifdef SMTD_UNIT_TEST
 /* Test mode - externally visible variables */
-smtd_state *smtd_active_states[SMTD_POOL_SIZE] = {[0 ... SMTD_POOL_SIZE-1] = NULL};
+smtd_state *smtd_active_head = NULL;
+smtd_state *smtd_active_tail = NULL;
 smtd_state smtd_states_pool[SMTD_POOL_SIZE] = {[0 ... SMTD_POOL_SIZE-1] = EMPTY_STATE};
+uint8_t smtd_free_slots[SMTD_POOL_SIZE];
+uint8_t smtd_free_slots_size = 0;
+bool smtd_free_slots_ready = false;
 uint8_t smtd_active_states_size = 0;
+uint8_t smtd_active_seq = 0;
+smtd_state *smtd_undetermined_head = NULL;
+smtd_state *smtd_timeout_head = NULL;
+bool smtd_timeout_head_valid = true;
+uint8_t smtd_position_index[MATRIX_ROWS][MATRIX_COLS] = {{0}};
 bool smtd_bypass = false;
+bool smtd_emulating = false;
+uint8_t smtd_output_depth = 0;
+bool smtd_report_pending = false;
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+// as if the last output went out a whole delay ago
+uint32_t smtd_output_sent_at = -(uint32_t) SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS;
+#endif
+#if SMTD_OUTPUT_QUEUE
+smtd_stream_item smtd_stream[SMTD_STREAM_SIZE];
+uint8_t smtd_stream_head = 0;
+uint8_t smtd_stream_size = 0;
+#if SMTD_MACRO_STREAM
+char smtd_stream_chars[SMTD_STREAM_CHARS_SIZE];
+uint8_t smtd_stream_chars_head = 0;
+uint8_t smtd_stream_chars_size = 0;
+#endif
+bool smtd_stream_emitting = false;
+deferred_token smtd_stream_token = INVALID_DEFERRED_TOKEN;
+smtd_held_event smtd_held_events[SMTD_STREAM_HELD_SIZE];
+uint8_t smtd_held_events_size = 0;
+bool smtd_held_replaying = false;
+#endif
 smtd_state *smtd_executing_state = NULL;
+deferred_token smtd_timer_token = INVALID_DEFERRED_TOKEN;
+smtd_time_t smtd_timer_at = 0;
+bool smtd_timer_dispatching = false;
+smtd_time_t smtd_clock = 0;
+uint32_t smtd_wall_clock = 0;
+uint32_t smtd_fired_at = 0;
+#if SMTD_UNMANAGED_KEYS
+bool smtd_unmanaged_passed = false;
+#endif
+#if SMTD_LEARN_UNHANDLED
+uint8_t smtd_unhandled_keycodes[256 / 8] = {0};
+#endif
+smtd_speculative_stats smtd_speculative = {0};
+bool smtd_flow_streak = false;
+smtd_time_t smtd_flow_tap_at = 0;
+#if SMTD_RHYTHM_MODEL
+smtd_rhythm smtd_rhythm_model = {0};
+#endif
+#if SMTD_ADAPTIVE_TERMS
+smtd_adaptive_term smtd_adaptive_terms[MATRIX_ROWS][MATRIX_COLS];
+bool smtd_adaptive_loaded = false;
+smtd_adaptive_sample smtd_adaptive_pending = {0};
+deferred_token smtd_adaptive_save_token = INVALID_DEFERRED_TOKEN;
+#endif
 #else
 /* Normal mode - internal variables */
-static smtd_state *smtd_active_states[SMTD_POOL_SIZE] = {[0 ... SMTD_POOL_SIZE-1] = NULL};
+static smtd_state *smtd_active_head = NULL;
+static smtd_state *smtd_active_tail = NULL;
 static smtd_state smtd_states_pool[SMTD_POOL_SIZE] = {[0 ... SMTD_POOL_SIZE-1] = EMPTY_STATE};
+static uint8_t smtd_free_slots[SMTD_POOL_SIZE];
+static uint8_t smtd_free_slots_size = 0;
+static bool smtd_free_slots_ready = false;
 static uint8_t smtd_active_states_size = 0;
+static uint8_t smtd_active_seq = 0;
+static smtd_state *smtd_undetermined_head = NULL;
+static smtd_state *smtd_timeout_head = NULL;
+static bool smtd_timeout_head_valid = true;
+static uint8_t smtd_position_index[MATRIX_ROWS][MATRIX_COLS] = {{0}};
 static bool smtd_bypass = false;
+static bool smtd_emulating = false;
+static uint8_t smtd_output_depth = 0;
+static bool smtd_report_pending = false;
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+// as if the last output went out a whole delay ago
+static uint32_t smtd_output_sent_at = -(uint32_t) SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS;
+#endif
+#if SMTD_OUTPUT_QUEUE
+static smtd_stream_item smtd_stream[SMTD_STREAM_SIZE];
+static uint8_t smtd_stream_head = 0;
+static uint8_t smtd_stream_size = 0;
+#if SMTD_MACRO_STREAM
+static char smtd_stream_chars[SMTD_STREAM_CHARS_SIZE];
+static uint8_t smtd_stream_chars_head = 0;
+static uint8_t smtd_stream_chars_size = 0;
+#endif
+static bool smtd_stream_emitting = false;
+static deferred_token smtd_stream_token = INVALID_DEFERRED_TOKEN;
+static smtd_held_event smtd_held_events[SMTD_STREAM_HELD_SIZE];
+static uint8_t smtd_held_events_size = 0;
+static bool smtd_held_replaying = false;
+#endif
 static smtd_state *smtd_executing_state = NULL;
+static deferred_token smtd_timer_token = INVALID_DEFERRED_TOKEN;
+static smtd_time_t smtd_timer_at = 0;
+static bool smtd_timer_dispatching = false;
+static smtd_time_t smtd_clock = 0;
+static uint32_t smtd_wall_clock = 0;
+static uint32_t smtd_fired_at = 0;
+#if SMTD_UNMANAGED_KEYS
+static bool smtd_unmanaged_passed = false;
+#endif
+#if SMTD_LEARN_UNHANDLED
+static uint8_t smtd_unhandled_keycodes[256 / 8] = {0};
+#endif
+static smtd_speculative_stats smtd_speculative = {0};
+static bool smtd_flow_streak = false;
+static smtd_time_t smtd_flow_tap_at = 0;
+#if SMTD_RHYTHM_MODEL
+static smtd_rhythm smtd_rhythm_model = {0};
+#endif
+#if SMTD_ADAPTIVE_TERMS
+static smtd_adaptive_term smtd_adaptive_terms[MATRIX_ROWS][MATRIX_COLS];
+static bool smtd_adaptive_loaded = false;
+static smtd_adaptive_sample smtd_adaptive_pending = {0};
+static deferred_token smtd_adaptive_save_token = INVALID_DEFERRED_TOKEN;
+#endif
+#endif
+
+// Links of the active list are pointers, or pool indices + 1 with SMTD_COMPACT_STATE
+static smtd_state *smtd_link_to_state(smtd_state_link link) {
+#if SMTD_COMPACT_STATE
+    return link == SMTD_NO_LINK ? NULL : &smtd_states_pool[link - 1];
+#else
+    return link;
+#endif
+}
+
+static smtd_state_link smtd_state_to_link(smtd_state *state) {
+#if SMTD_COMPACT_STATE
+    return state == NULL ? SMTD_NO_LINK : (smtd_state_link) (state - smtd_states_pool) + 1;
+#else
+    return state;
+#endif
+}
+
+static smtd_state *smtd_next(smtd_state *state) {
+    return smtd_link_to_state(state->next);
+}
+
+static smtd_state *smtd_prev(smtd_state *state) {
+    return smtd_link_to_state(state->prev);
+}
+
+// State times are smtd_time_t, which wraps every 65 seconds with
+// SMTD_COMPACT_STATE, so they are only ever subtracted from each other.
+//
+// sm_td doesn't look at the clock while it makes decisions: smtd_now() is the
+// time of the key event being processed (record->event.time) or the deadline
+// of the timeout being fired. A slow scan or a late deferred exec then doesn't
+// change any tap / hold decision, and the same input trace always gives the
+// same output. The real clock is read once per event or timer tick, and only
+// to arm the deferred exec.
+static smtd_time_t smtd_now(void) {
+    return smtd_clock;
+}
+
+// Unmanaged states (SMTD_UNMANAGED_KEYS) never call into the user hooks
+static bool smtd_state_managed(smtd_state *state) {
+#if SMTD_UNMANAGED_KEYS
+    return !state->unmanaged;
+#else
+    return true;
+#endif
+}
+
+#if SMTD_LEARN_UNHANDLED
+// Only basic keycodes are learned: they are what plain keys send, and a bitset
+// over them is exact and fits into 32 bytes
+static bool smtd_learned_unhandled(uint16_t keycode) {
+    return keycode <= 0xFF && (smtd_unhandled_keycodes[keycode >> 3] >> (keycode & 7)) & 1;
+}
+
+static void smtd_learn_unhandled(uint16_t keycode) {
+    if (keycode > 0xFF) return;
+    smtd_unhandled_keycodes[keycode >> 3] |= 1 << (keycode & 7);
+}
 #endif
 
 /* ************************************* *
@@ -121,7 +291,7 @@ char* smtd_state_to_str(smtd_state *state) {
     static char buffer_state[64];
 
     SMTD_SNDEBUG(buffer_state, sizeof(buffer_state), "S[%d](@%d.%d#%s->%s){%s/%s}",
-             state->idx,
+             (int) (state - smtd_states_pool),
              state->pressed_keyposition.row,
              state->pressed_keyposition.col,
              smtd_keycode_to_str(state->pressed_keycode),
@@ -136,7 +306,7 @@ char* smtd_state_to_str2(smtd_state *state) {
     static char buffer_state2[64];
 
     SMTD_SNDEBUG(buffer_state2, sizeof(buffer_state2), "S[%d](@%d.%d#%s->%s){%s/%s}",
-             state->idx,
+             (int) (state - smtd_states_pool),
              state->pressed_keyposition.row,
              state->pressed_keyposition.col,
              smtd_keycode_to_str(state->pressed_keycode),
@@ -157,10 +327,93 @@ char* smtd_record_to_str(keyrecord_t *record) {
 
 #endif
 
+/* ************************************* *
+ *         OUTPUT TRANSACTION            *
+ * ************************************* */
+
+// Handling a key event or a timer tick is a transaction: reports requested with
+// smtd_send_report are held back until it ends or until a key is sent, so the
+// report a key goes out with already carries the mods set before it. Mods
+// themselves change right away, so nothing reading them sees a stale value.
+
+// With SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS, outputs of sm_td's own (a
+// report, an emulated key, a key sent directly) go out at least that far apart.
+// One that is due earlier is queued like macro stream output and sent from a
+// deferred exec, so the keyboard keeps scanning meanwhile and a lone output is
+// never delayed. Reports of QMK and of other features are not touched.
+#if SMTD_OUTPUT_QUEUE
+static bool smtd_stream_queues_output(void);
+static void smtd_stream_push(smtd_stream_item item);
+static smtd_stream_item smtd_stream_own_output(smtd_stream_kind kind);
+#endif
+
+static void smtd_output_sent(void) {
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+    smtd_output_sent_at = timer_read32();
+#endif
+}
+
+static void smtd_report_now(void) {
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_queues_output()) {
+        smtd_stream_push(smtd_stream_own_output(SMTD_STREAM_REPORT));
+        return;
+    }
+#endif
+    smtd_output_sent();
+    send_keyboard_report();
+}
+
+void smtd_send_report(void) {
+    if (smtd_output_depth > 0) {
+        smtd_report_pending = true;
+        return;
+    }
+    smtd_report_now();
+}
+
+static void smtd_output_flush(void) {
+    if (!smtd_report_pending) return;
+    smtd_report_pending = false;
+    smtd_report_now();
+}
+
+static void smtd_output_begin(void) {
+    smtd_output_depth++;
+}
+
+static void smtd_output_end(void) {
+    if (--smtd_output_depth == 0) {
+        smtd_output_flush();
+    }
+}
+
 /* ************************************* *
  *             TIMEOUTS                  *
  * ************************************* */
 
+#if SMTD_RHYTHM_MODEL
+static void smtd_rhythm_event(keyrecord_t *record);
+static void smtd_rhythm_smooth(smtd_time_diff_t *p1, smtd_time_diff_t *p2);
+#endif
+
+static void smtd_speculate_tap(smtd_state *state);
+static bool smtd_speculation_settled(smtd_state *state, smtd_action action);
+
+static bool smtd_flow_tap(smtd_state *state);
+static void smtd_flow_track(smtd_state *state, smtd_action action, smtd_resolution resolution);
+static void smtd_flow_pass(void);
+
+#if SMTD_ADAPTIVE_TERMS
+static uint32_t smtd_adaptive_tap_term(smtd_state *state);
+static uint32_t smtd_adaptive_release_percent(smtd_state *state);
+static void smtd_adaptive_press(uint16_t pressed_keycode);
+static void smtd_adaptive_sample_tap(smtd_state *state);
+static void smtd_adaptive_sample_lone_hold(smtd_state *state);
+static void smtd_adaptive_lone_hold_released(smtd_state *state);
+static void smtd_adaptive_sample_hold(smtd_state *state);
+#endif
+
 uint32_t timeout_reset_seq(uint32_t trigger_time, void *cb_arg) {
     smtd_state *state = (smtd_state *) cb_arg;
     SMTD_DEBUG_INPUT(">> %s timeout_reset_seq", smtd_state_to_str(state));
@@ -174,6 +427,9 @@ uint32_t timeout_touch(uint32_t trigger_time, void *cb_arg) {
     smtd_state *state = (smtd_state *) cb_arg;
     SMTD_DEBUG_INPUT(">> %s timeout_touch", smtd_state_to_str(state));
     SMTD_DEBUG_OFFSET_INC;
+#if SMTD_ADAPTIVE_TERMS
+    smtd_adaptive_sample_lone_hold(state);
+#endif
     smtd_apply_stage(state, SMTD_STAGE_HOLD);
     smtd_handle_action(state, SMTD_ACTION_HOLD);
     SMTD_DEBUG_OFFSET_DEC;
@@ -220,11 +476,361 @@ uint32_t timeout_hold_release(uint32_t trigger_time, void *cb_arg) {
     return 0;
 }
 
+// All state timeouts share a single QMK deferred exec. Each state keeps its own
+// deadline, and the exec is armed for the earliest one, so sm_td occupies one
+// MAX_DEFERRED_EXECUTORS slot no matter how many keys are pending.
+// Arming is O(1): the exec is only moved when the new deadline comes earlier.
+// Cancelling just drops the deadline; a tick that finds nothing due re-arms for
+// the next deadline or frees the slot.
+
+static bool smtd_time_reached(smtd_time_t now, smtd_time_t deadline) {
+    return (smtd_time_diff_t) (now - deadline) >= 0;
+}
+
+// Deadlines count from the event time, while the deferred exec counts from the
+// real clock, so a deadline that is already behind fires on the next tick.
+// With SMTD_SPLIT_LATENCY_MS, the exec also waits for the events of the other
+// half that may still be on their way.
+static uint32_t smtd_exec_delay(smtd_time_t deadline) {
+    smtd_time_diff_t delay = (smtd_time_diff_t) (deadline + SMTD_SPLIT_LATENCY_MS - (smtd_time_t) smtd_wall_clock);
+    return delay > 0 ? (uint32_t) delay : 1;
+}
+
+// smtd_timeout_head caches the state whose deadline fires first, ties go to the
+// earlier pressed one. Only that one state is cached, not an order: scheduling an
+// earlier deadline replaces it in O(1), and lookups are O(1) while it stays valid.
+// Once the head stops waiting (fired, cancelled or moved), the next lookup walks
+// all active states again, O(n) in SMTD_POOL_SIZE. Events that leave the head
+// alone stay O(1); firing or cancelling the head costs one walk each.
+static bool smtd_timeout_before(smtd_state *state, smtd_state *other) {
+    if (state->timeout_at != other->timeout_at) {
+        return !smtd_time_reached(state->timeout_at, other->timeout_at);
+    }
+    return state->seq < other->seq;
+}
+
+static void smtd_timeout_dropped(smtd_state *state) {
+    if (state == smtd_timeout_head) {
+        smtd_timeout_head = NULL;
+        smtd_timeout_head_valid = false;
+    }
+}
+
+static void smtd_schedule_timeout(smtd_state *state, uint32_t delay) {
+    smtd_timeout_dropped(state);
+    state->timeout_at = (smtd_time_t) (smtd_now() + delay);
+    state->timeout_pending = true;
+    if (smtd_timeout_head_valid &&
+        (smtd_timeout_head == NULL || smtd_timeout_before(state, smtd_timeout_head))) {
+        smtd_timeout_head = state;
+    }
+
+    if (smtd_timer_dispatching) {
+        // smtd_timer_tick re-arms the exec for the earliest deadline when it returns
+        return;
+    }
+
+    if (smtd_timer_token == INVALID_DEFERRED_TOKEN) {
+        smtd_timer_token = defer_exec(smtd_exec_delay(state->timeout_at), smtd_timer_tick, NULL);
+        smtd_timer_at = state->timeout_at;
+        return;
+    }
+
+    if (!smtd_time_reached(state->timeout_at, smtd_timer_at)) {
+        extend_deferred_exec(smtd_timer_token, smtd_exec_delay(state->timeout_at));
+        smtd_timer_at = state->timeout_at;
+    }
+}
+
+static void smtd_cancel_timeout(smtd_state *state) {
+    state->timeout_pending = false;
+    smtd_timeout_dropped(state);
+}
+
+static void smtd_fire_timeout(smtd_state *state) {
+    state->timeout_pending = false;
+    smtd_timeout_dropped(state);
+    // the timeout is handled as of its deadline, however late it actually runs;
+    // pending deadlines are never far from the clock, so they compare safely
+    if (smtd_time_reached(state->timeout_at, smtd_clock)) {
+        smtd_clock = state->timeout_at;
+    }
+    smtd_fired_at = smtd_wall_clock -
+                    (uint32_t) (smtd_time_diff_t) ((smtd_time_t) smtd_wall_clock - state->timeout_at);
+    switch (state->stage) {
+        case SMTD_STAGE_TOUCH:
+            timeout_touch(state->timeout_at, state);
+            break;
+        case SMTD_STAGE_SEQUENCE:
+            timeout_sequence(state->timeout_at, state);
+            break;
+        case SMTD_STAGE_TOUCH_RELEASE:
+            timeout_touch_release(state->timeout_at, state);
+            break;
+        case SMTD_STAGE_HOLD_RELEASE:
+            timeout_hold_release(state->timeout_at, state);
+            break;
+        case SMTD_STAGE_NONE:
+        case SMTD_STAGE_HOLD:
+            break;
+    }
+}
+
+static smtd_state *smtd_earliest_timeout(void) {
+    if (smtd_timeout_head_valid) {
+        return smtd_timeout_head;
+    }
+
+    smtd_state *earliest = NULL;
+    for (smtd_state *state = smtd_active_head; state != NULL; state = smtd_next(state)) {
+        if (!state->timeout_pending) continue;
+        if (earliest == NULL || smtd_timeout_before(state, earliest)) {
+            earliest = state;
+        }
+    }
+    smtd_timeout_head = earliest;
+    smtd_timeout_head_valid = true;
+    return earliest;
+}
+
+// Fires every deadline up to `until` in deadline order. A fired timeout may
+// schedule a new one for its state, which is always later, so the loop ends.
+static smtd_state *smtd_fire_timeouts_until(smtd_time_t until) {
+    smtd_state *state;
+    while ((state = smtd_earliest_timeout()) != NULL && smtd_time_reached(until, state->timeout_at)) {
+        smtd_fire_timeout(state);
+    }
+    return state;
+}
+
+uint32_t smtd_timer_tick(uint32_t trigger_time, void *cb_arg) {
+    smtd_wall_clock = timer_read32();
+    smtd_timer_dispatching = true;
+    smtd_output_begin();
+
+    smtd_state *state = smtd_fire_timeouts_until((smtd_time_t) (smtd_wall_clock - SMTD_SPLIT_LATENCY_MS));
+
+    smtd_output_end();
+    smtd_timer_dispatching = false;
+
+    if (state == NULL) {
+        smtd_timer_token = INVALID_DEFERRED_TOKEN;
+        return 0;
+    }
+
+    // QMK adds the returned delay to trigger_time, not to the current time
+    smtd_timer_at = state->timeout_at;
+    smtd_time_diff_t delay =
+        (smtd_time_diff_t) (state->timeout_at + SMTD_SPLIT_LATENCY_MS - (smtd_time_t) trigger_time);
+    return delay > 0 ? (uint32_t) delay : 1;
+}
+
+// Moves the clock to the time of a key event. Timeouts that were due before
+// the event fire first, even if their deferred exec hasn't run yet.
+static void smtd_clock_event(keyrecord_t *record) {
+    smtd_wall_clock = timer_read32();
+    uint32_t event_time = smtd_wall_clock;
+
+    // QMK stamps events with the 16-bit timer_read(), widen it against the real
+    // clock. Records sm_td or other features make up may carry no time at all.
+    if (record->event.time != 0) {
+        uint16_t age = (uint16_t) ((uint16_t) smtd_wall_clock - record->event.time);
+        // a stamp slightly ahead of the clock (QMK may set its lowest bit) counts as now
+        if (age < 0x8000) {
+            event_time -= age;
+        }
+    }
+
+#if SMTD_SPLIT_LATENCY_MS > 0
+    // QMK stamps the other half's events when they arrive over the transport
+    uint8_t latency = smtd_split_latency(record->event.key);
+    event_time -= latency < SMTD_SPLIT_LATENCY_MS ? latency : SMTD_SPLIT_LATENCY_MS;
+#endif
+
+    smtd_fire_timeouts_until((smtd_time_t) event_time);
+
+    // An event can't go behind a timeout that has already fired (e.g. the event
+    // was held behind a macro stream). It may go behind earlier events though, when
+    // the other half's events are moved back, so pauses between states can be
+    // negative. With no active states nothing is compared with the event time.
+    if (smtd_active_head != NULL && (int32_t) (event_time - smtd_fired_at) < 0) {
+        event_time = smtd_fired_at;
+    }
+    smtd_clock = (smtd_time_t) event_time;
+}
+
+
+/* ************************************* *
+ *             ACTIVE STATES             *
+ * ************************************* */
+
+// Active states form an intrusive doubly linked list in press order: head is the
+// oldest state, tail the most recent one. Appending and unlinking are O(1), so
+// a cascade that finalizes several states never shifts the rest of the stack.
+// Each state also carries a press sequence number, so "is A after B" is a single
+// comparison instead of a list walk.
+
+// Matrix positions other than (0,0) are owned by at most one state, which is
+// looked up in smtd_position_index (pool slot + 1, 0 when free). Position (0,0)
+// also carries keycodes that do not come from the matrix (combos, etc.), so it
+// and any out-of-matrix position keep matching states by scanning the list.
+static bool smtd_position_indexed(keypos_t key) {
+    return key.row < MATRIX_ROWS && key.col < MATRIX_COLS && (key.row != 0 || key.col != 0);
+}
+
+static smtd_state *smtd_position_owner(keypos_t key) {
+    uint8_t slot = smtd_position_index[key.row][key.col];
+    return slot == 0 ? NULL : &smtd_states_pool[slot - 1];
+}
+
+static bool smtd_is_state_key(smtd_state *state, uint16_t pressed_keycode, keyrecord_t *record) {
+    return (record->event.key.row == state->pressed_keyposition.row &&
+            record->event.key.col == state->pressed_keyposition.col) &&
+           (
+                pressed_keycode == state->pressed_keycode ||
+                pressed_keycode == state->desired_keycode ||
+                record->event.key.row != 0 || record->event.key.col != 0
+           );
+}
+
+// An action of a state is deferred while any earlier state is still undetermined
+// (neither in SEQUENCE nor DETERMINED). smtd_undetermined_head tracks the first
+// such state in press order and is updated whenever a state changes its stage or
+// resolution, so the check in smtd_handle_action is O(1) and a cascade stays linear.
+
+static bool smtd_is_active(smtd_state *state) {
+    return state->prev != SMTD_NO_LINK || smtd_active_head == state;
+}
+
+static bool smtd_is_undetermined(smtd_state *state) {
+    return state->stage != SMTD_STAGE_SEQUENCE && state->resolution != SMTD_RESOLUTION_DETERMINED;
+}
+
+static void smtd_undetermined_advance(smtd_state *from) {
+    while (from != NULL && !smtd_is_undetermined(from)) {
+        from = smtd_next(from);
+    }
+    smtd_undetermined_head = from;
+}
+
+static void smtd_undetermined_update(smtd_state *state) {
+    if (!smtd_is_active(state)) {
+        return;
+    }
+
+    if (smtd_is_undetermined(state)) {
+        if (smtd_undetermined_head == NULL || state->seq < smtd_undetermined_head->seq) {
+            smtd_undetermined_head = state;
+        }
+        return;
+    }
+
+    if (state == smtd_undetermined_head) {
+        smtd_undetermined_advance(smtd_next(state));
+    }
+}
+
+static void smtd_active_append(smtd_state *state) {
+    if (smtd_active_seq == UINT8_MAX) {
+        // renumber the live states so sequence numbers never wrap
+        smtd_active_seq = 0;
+        for (smtd_state *live = smtd_active_head; live != NULL; live = smtd_next(live)) {
+            live->seq = ++smtd_active_seq;
+        }
+    }
+    state->seq = ++smtd_active_seq;
+
+    if (smtd_position_indexed(state->pressed_keyposition)) {
+        smtd_position_index[state->pressed_keyposition.row][state->pressed_keyposition.col] =
+                (uint8_t) (state - smtd_states_pool) + 1;
+    }
+
+    state->prev = smtd_state_to_link(smtd_active_tail);
+    state->next = SMTD_NO_LINK;
+    if (smtd_active_tail != NULL) {
+        smtd_active_tail->next = smtd_state_to_link(state);
+    } else {
+        smtd_active_head = state;
+    }
+    smtd_active_tail = state;
+    smtd_active_states_size++;
+    smtd_undetermined_update(state);
+}
+
+static bool smtd_active_unlink(smtd_state *state) {
+    // Only unlink if the state is still in the active list. Guards against a
+    // double removal (e.g. a stale timeout firing for an already-removed state),
+    // which would otherwise detach its former neighbours or underflow the size.
+    if (!smtd_is_active(state)) {
+        return false;
+    }
+
+    if (state == smtd_undetermined_head) {
+        smtd_undetermined_advance(smtd_next(state));
+    }
+
+    if (state->prev != SMTD_NO_LINK) {
+        smtd_prev(state)->next = state->next;
+    } else {
+        smtd_active_head = smtd_next(state);
+    }
+    if (state->next != SMTD_NO_LINK) {
+        smtd_next(state)->prev = state->prev;
+    } else {
+        smtd_active_tail = smtd_prev(state);
+    }
+    if (smtd_position_indexed(state->pressed_keyposition) &&
+        smtd_position_owner(state->pressed_keyposition) == state) {
+        smtd_position_index[state->pressed_keyposition.row][state->pressed_keyposition.col] = 0;
+    }
+
+    state->prev = SMTD_NO_LINK;
+    state->next = SMTD_NO_LINK;
+    smtd_active_states_size--;
+    return true;
+}
+
+// Unused pool slots are kept on a stack of indices, so taking and returning a
+// slot is a pop and a push instead of a scan over the whole pool.
+
+static void smtd_free_slots_reset(void) {
+    for (uint8_t i = 0; i < SMTD_POOL_SIZE; i++) {
+        // lowest slot on top, so slots are handed out in pool order
+        smtd_free_slots[i] = SMTD_POOL_SIZE - 1 - i;
+    }
+    smtd_free_slots_size = SMTD_POOL_SIZE;
+    smtd_free_slots_ready = true;
+}
+
+static smtd_state *smtd_take_free_slot(void) {
+    if (!smtd_free_slots_ready) {
+        smtd_free_slots_reset();
+    }
+    if (smtd_free_slots_size == 0) {
+        return NULL;
+    }
+    return &smtd_states_pool[smtd_free_slots[--smtd_free_slots_size]];
+}
+
+static void smtd_return_slot(smtd_state *state) {
+    smtd_free_slots[smtd_free_slots_size++] = (uint8_t) (state - smtd_states_pool);
+}
+
 
 /* ************************************* *
  *             STATE PROCESSING          *
  * ************************************* */
 
+#if SMTD_OUTPUT_QUEUE
+static bool smtd_stream_holds(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
+#endif
+
+#if SMTD_UNMANAGED_KEYS
+static bool smtd_key_unmanaged(keypos_t key, uint16_t keycode);
+static bool smtd_unmanaged_pass_through(uint16_t pressed_keycode, keyrecord_t *record);
+static bool smtd_unmanaged_settled(void);
+#endif
+
 bool process_smtd(uint16_t pressed_keycode, keyrecord_t *record) {
     return smtd_process_desired(pressed_keycode, record, 0);
 }
@@ -237,55 +843,96 @@ bool smtd_process_desired(uint16_t pressed_keycode, keyrecord_t *record, uint16_
         return true;
     }
 
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_holds(pressed_keycode, record, desired_keycode)) {
+        SMTD_DEBUG_INPUT(">> %s HELD BEHIND STREAM %s",
+                         smtd_record_to_str(record),
+                         smtd_keycode_to_str_uncertain(pressed_keycode, desired_keycode == 0));
+        return false;
+    }
+#endif
+
+    smtd_output_begin();
+    smtd_clock_event(record);
+#if SMTD_RHYTHM_MODEL
+    smtd_rhythm_event(record);
+#endif
+
+#if SMTD_ADAPTIVE_TERMS
+    if (record->event.pressed) {
+        smtd_adaptive_press(pressed_keycode);
+    }
+#endif
+
+#if SMTD_UNMANAGED_KEYS
+    if (desired_keycode == 0 && smtd_unmanaged_pass_through(pressed_keycode, record)) {
+        SMTD_DEBUG_INPUT(">> %s UNMANAGED KEY %s",
+                         smtd_record_to_str(record),
+                         smtd_keycode_to_str(pressed_keycode));
+        if (record->event.pressed) {
+            smtd_flow_pass();
+        }
+        smtd_output_end();
+        return true;
+    }
+#endif
+
     SMTD_DEBUG_INPUT(">> %s GOT KEY %s",
                smtd_record_to_str(record),
                smtd_keycode_to_str_uncertain(pressed_keycode, desired_keycode == 0));
 
-    smtd_apply_to_stack(0, pressed_keycode, record, desired_keycode);
+    smtd_apply_to_stack(pressed_keycode, record, desired_keycode);
+    smtd_output_end();
+
+#if SMTD_UNMANAGED_KEYS
+    if (smtd_unmanaged_passed) {
+        smtd_unmanaged_passed = false;
+        return true;
+    }
+#endif
     return false;
 }
 
-void
-smtd_apply_to_stack(uint8_t starting_idx, uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode) {
-    SMTD_DEBUG("%s apply_to_stack starting idx=%d",
-               smtd_record_to_str(record),
-               starting_idx);
+void smtd_apply_to_stack(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode) {
+    SMTD_DEBUG("%s apply_to_stack", smtd_record_to_str(record));
 
-    bool processed_state = false;
+    bool indexed = smtd_position_indexed(record->event.key);
+    smtd_state *owner = indexed ? smtd_position_owner(record->event.key) : NULL;
+    bool processed_state = owner != NULL;
 
-    for (uint8_t i = starting_idx; i < smtd_active_states_size; i++) {
-        smtd_state *state = smtd_active_states[i];
+    smtd_state *state = smtd_active_head;
+    while (state != NULL) {
+        // remember the successor: the state may unlink itself while handling the event
+        smtd_state *next = smtd_next(state);
 
-        bool is_state_key = (record->event.key.row == state->pressed_keyposition.row &&
-                             record->event.key.col == state->pressed_keyposition.col) &&
-                            (
-                                 pressed_keycode == state->pressed_keycode ||
-                                 pressed_keycode == state->desired_keycode ||
-                                 record->event.key.row != 0 || record->event.key.col != 0
-                            );
+        bool is_state_key = indexed ? state == owner : smtd_is_state_key(state, pressed_keycode, record);
 
         processed_state = processed_state | is_state_key;
 
+        if (!is_state_key && state->stage == SMTD_STAGE_HOLD) {
+            // a held state only reacts to its own release
+            state = next;
+            continue;
+        }
+
         SMTD_DEBUG_OFFSET_INC;
         smtd_apply_event(is_state_key, state, pressed_keycode, record);
-        if (state->stage == SMTD_STAGE_NONE) {
-            // stack has been moved with one element left
-            // fixme-sm maybe move to cleanup stage?
-            i--;
+        if (state->stage != SMTD_STAGE_NONE) {
+            next = smtd_next(state);
         }
+        state = next;
 
         SMTD_DEBUG_OFFSET_DEC;
     }
 
     SMTD_DEBUG_OFFSET_INC;
-    uint8_t idx = smtd_active_states_size;
-    while (idx > 0) {
-        smtd_state *state = smtd_active_states[idx - 1];
+    state = smtd_active_tail;
+    while (state != NULL) {
         if (state->stage == SMTD_STAGE_TOUCH_RELEASE) {
             SMTD_DEBUG("%s clean up", smtd_state_to_str(state));
             smtd_handle_action(state, SMTD_ACTION_TAP);
             smtd_apply_stage(state, SMTD_STAGE_NONE);
-            idx = smtd_active_states_size;
+            state = smtd_active_tail;
             continue;
         }
 
@@ -293,12 +940,12 @@ smtd_apply_to_stack(uint8_t starting_idx, uint16_t pressed_keycode, keyrecord_t
             SMTD_DEBUG("%s clean up", smtd_state_to_str(state));
             smtd_handle_action(state, SMTD_ACTION_RELEASE);
             smtd_apply_stage(state, SMTD_STAGE_NONE);
-            idx = smtd_active_states_size;
+            state = smtd_active_tail;
             continue;
         }
 
         if (state->stage == SMTD_STAGE_SEQUENCE) {
-            idx--;
+            state = smtd_prev(state);
             continue;
         }
 
@@ -319,18 +966,89 @@ smtd_apply_to_stack(uint8_t starting_idx, uint16_t pressed_keycode, keyrecord_t
         return;
     }
 
+#if SMTD_UNMANAGED_KEYS
+    if (desired_keycode == 0 && smtd_key_unmanaged(record->event.key, pressed_keycode) && smtd_unmanaged_settled()) {
+        SMTD_DEBUG("<< %s UNMANAGED KEY PASSES", smtd_record_to_str(record));
+        SMTD_DEBUG_FULL();
+        smtd_unmanaged_passed = true;
+        smtd_flow_pass();
+        return;
+    }
+#endif
+
     smtd_create_state(pressed_keycode, record, desired_keycode);
 }
 
-void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode) {
-    smtd_state *state = NULL;
-    for (uint8_t i = 0; i < SMTD_POOL_SIZE; i++) {
-        if (smtd_states_pool[i].stage == SMTD_STAGE_NONE) {
-            state = &smtd_states_pool[i];
-            break;
+static uint32_t smtd_tap_term(smtd_state *state) {
+#if SMTD_ADAPTIVE_TERMS
+    return smtd_adaptive_tap_term(state);
+#else
+    return get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP);
+#endif
+}
+
+// The per-key user hooks for the keycode, or the defaults for unmanaged states
+static uint32_t smtd_eval_timeout(smtd_state *state, uint16_t keycode, smtd_timeout timeout) {
+    uint32_t value = smtd_state_managed(state) && get_smtd_timeout
+                     ? get_smtd_timeout(keycode, timeout)
+                     : get_smtd_timeout_default(timeout);
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+static uint8_t smtd_eval_max_tap_count(smtd_state *state, uint16_t keycode) {
+    return smtd_state_managed(state) && get_smtd_max_tap_count
+           ? get_smtd_max_tap_count(keycode)
+           : SMTD_GLOBAL_MAX_TAP_COUNT;
+}
+
+static bool smtd_eval_feature(smtd_state *state, uint16_t keycode, smtd_feature feature) {
+    return smtd_state_managed(state) && smtd_feature_enabled
+           ? smtd_feature_enabled(keycode, feature)
+           : smtd_feature_enabled_default(keycode, feature);
+}
+
+#if SMTD_COMPACT_STATE
+// The compact layout keeps no snapshot: the hooks are evaluated on every read,
+// for the keycode the state has resolved so far
+static void smtd_take_snapshot(smtd_state *state, uint16_t keycode) {
+}
+
+static uint16_t smtd_hook_keycode(smtd_state *state) {
+    if (state->desired_keycode != 0) return state->desired_keycode;
+#if SMTD_UNMANAGED_KEYS
+    if (state->unmanaged) return state->pressed_keycode;
+#endif
+    return smtd_position_keycode(state);
+}
+#else
+// Evaluates the per-key user hooks for the keycode once, so that stage
+// changes and event handling read plain fields instead of calling into a switch
+static void smtd_take_snapshot(smtd_state *state, uint16_t keycode) {
+    for (uint8_t timeout = 0; timeout < SMTD_TIMEOUTS_SIZE; timeout++) {
+        state->timeouts[timeout] = smtd_eval_timeout(state, keycode, timeout);
+    }
+
+    state->max_tap_count = smtd_eval_max_tap_count(state, keycode);
+
+    state->features = 0;
+    for (uint8_t feature = 0; feature < SMTD_FEATURES_SIZE; feature++) {
+        if (smtd_eval_feature(state, keycode, feature)) {
+            state->features |= 1 << feature;
         }
     }
+}
+#endif
+
+static uint8_t smtd_max_tap_count(smtd_state *state) {
+#if SMTD_COMPACT_STATE
+    return smtd_eval_max_tap_count(state, smtd_hook_keycode(state));
+#else
+    return state->max_tap_count;
+#endif
+}
 
+void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode) {
+    smtd_state *state = smtd_take_free_slot();
     if (state == NULL) {
         SMTD_DEBUG("<< %s NO FREE STATES",
                    smtd_record_to_str(record));
@@ -338,14 +1056,28 @@ void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t d
         return;
     }
 
-    smtd_active_states[smtd_active_states_size] = state;
-    state->idx = smtd_active_states_size;
     state->pressed_keycode = pressed_keycode;
     state->pressed_keyposition = record->event.key;
-    if (desired_keycode > 0) {
-        state->desired_keycode = desired_keycode;
+    uint16_t keycode = desired_keycode;
+#if SMTD_UNMANAGED_KEYS
+    // an unmanaged key is sent as is, there is no need to look it up in the keymap
+    state->unmanaged = desired_keycode == 0 && smtd_key_unmanaged(record->event.key, pressed_keycode);
+    if (state->unmanaged) {
+        keycode = pressed_keycode;
     }
-    smtd_active_states_size++;
+#endif
+    if (keycode == 0) {
+        keycode = smtd_position_keycode(state);
+    }
+    if (desired_keycode > 0 || smtd_undetermined_head == NULL) {
+        // the touch action is executed right away, on the current layer
+        state->desired_keycode = keycode;
+    }
+    // Otherwise an earlier key (e.g. SMTD_LT) may still change the layer before
+    // this key's actions run: the snapshot of the press-time keycode only arms
+    // the touch timeout, and smtd_resolve_keycode takes it again
+    smtd_take_snapshot(state, keycode);
+    smtd_active_append(state);
 
     SMTD_DEBUG_OFFSET_INC;
     smtd_apply_event(true, state, pressed_keycode, record);
@@ -358,17 +1090,13 @@ void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t d
 }
 
 bool is_following_key(smtd_state *state, uint16_t pressed_keycode, keyrecord_t *record) {
-    for (uint8_t i = state->idx + 1; i < smtd_active_states_size; i++) {
-
-        bool is_following_state_key =
-                (record->event.key.row == smtd_active_states[i]->pressed_keyposition.row &&
-                 record->event.key.col == smtd_active_states[i]->pressed_keyposition.col) &&
-                (
-                     pressed_keycode == smtd_active_states[i]->pressed_keycode ||
-                     pressed_keycode == smtd_active_states[i]->desired_keycode ||
-                     record->event.key.row != 0 || record->event.key.col != 0
-                );
-        if (is_following_state_key) {
+    if (smtd_position_indexed(record->event.key)) {
+        smtd_state *owner = smtd_position_owner(record->event.key);
+        return owner != NULL && owner->seq > state->seq;
+    }
+
+    for (smtd_state *following = smtd_next(state); following != NULL; following = smtd_next(following)) {
+        if (smtd_is_state_key(following, pressed_keycode, record)) {
             return true;
         }
     }
@@ -381,6 +1109,14 @@ static bool smtd_chordal_same_hand(keypos_t a, keypos_t b);
 static bool smtd_chordal_all_same_hand(keypos_t current_pos);
 #endif
 
+// Whether a key pressed again within its sequence term is held right away. A key
+// behind an undecided one or with aggregated taps still waits for its tap term.
+static bool smtd_quick_tap(smtd_state *state) {
+    return smtd_feature_enabled_or_default(state, SMTD_FEATURE_QUICK_TAP) &&
+           !smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS) &&
+           smtd_worst_resolution_before(state) == SMTD_RESOLUTION_DETERMINED;
+}
+
 void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_keycode, keyrecord_t *record) {
     SMTD_DEBUG("--%s apply_event with %s, is_state_key=%d",
                smtd_state_to_str(state),
@@ -395,6 +1131,10 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
             if (is_state_key && record->event.pressed) {
                 smtd_apply_stage(state, SMTD_STAGE_TOUCH);
                 smtd_handle_action(state, SMTD_ACTION_TOUCH);
+                if (smtd_flow_tap(state)) {
+                    break;
+                }
+                smtd_speculate_tap(state);
                 break;
             }
             break;
@@ -402,9 +1142,26 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
 
         // -----------------------------------------------------------------------------------------
         case SMTD_STAGE_TOUCH: {
-            if (state->idx + 1 == smtd_active_states_size) {
+            if (state->action_performed == SMTD_ACTION_TAP) {
+                // flow tapped: the tap is sent already, the state only waits for its
+                // release, which starts the sequence unless another key came first
+                if (is_state_key && !record->event.pressed) {
+                    smtd_apply_stage(state, state->flow_interrupted ? SMTD_STAGE_NONE : SMTD_STAGE_SEQUENCE);
+                    break;
+                }
+
+                if (!is_state_key && record->event.pressed) {
+                    state->flow_interrupted = true;
+                }
+                break;
+            }
+
+            if (smtd_next(state) == NULL) {
                 // last state in stack
                 if (is_state_key && !record->event.pressed) {
+#if SMTD_ADAPTIVE_TERMS
+                    smtd_adaptive_sample_tap(state);
+#endif
                     if (!smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS)) {
                         smtd_handle_action(state, SMTD_ACTION_TAP);
                     }
@@ -413,14 +1170,29 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
                     break;
                 }
 
-#if SMTD_CHORDAL_HOLD
                 if (!is_state_key && record->event.pressed &&
-                    smtd_chordal_same_hand(state->pressed_keyposition, record->event.key)) {
-                    // Same-hand following key: drop the hold timeout so an idle
-                    // hold can no longer escalate this same-hand roll into an
-                    // accidental HOLD. The decision is deferred to key release.
-                    cancel_deferred_exec(state->timeout);
-                    state->timeout = INVALID_DEFERRED_TOKEN;
+                    smtd_feature_enabled_or_default(state, SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS)) {
+                    // hold now, the following key is pressed as soon as its state is created
+                    smtd_apply_stage(state, SMTD_STAGE_HOLD);
+                    smtd_handle_action(state, SMTD_ACTION_HOLD);
+                    break;
+                }
+
+#if SMTD_CHORDAL_HOLD
+                if (!is_state_key && record->event.pressed) {
+                    if (smtd_chordal_same_hand(state->pressed_keyposition, record->event.key)) {
+                        // Same-hand following key: drop the hold timeout so an idle
+                        // hold can no longer escalate this same-hand roll into an
+                        // accidental HOLD. The decision is deferred to key release.
+                        smtd_cancel_timeout(state);
+                        break;
+                    }
+#if SMTD_CHORDAL_PERMISSIVE
+                    // Cross-hand chord: hold now, the following key is pressed
+                    // as soon as its state is created
+                    smtd_apply_stage(state, SMTD_STAGE_HOLD);
+                    smtd_handle_action(state, SMTD_ACTION_HOLD);
+#endif
                 }
 #endif
 
@@ -433,12 +1205,25 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
                 break;
             }
 
+            if (!is_state_key && record->event.pressed &&
+                smtd_feature_enabled_or_default(state, SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS)) {
+                // the deferred actions of the keys in between run with the hold
+                smtd_apply_stage(state, SMTD_STAGE_HOLD);
+                smtd_handle_action(state, SMTD_ACTION_HOLD);
+                break;
+            }
+
 #if SMTD_CHORDAL_HOLD
             if (!is_state_key && record->event.pressed) {
                 if (smtd_chordal_same_hand(state->pressed_keyposition, record->event.key)) {
-                    cancel_deferred_exec(state->timeout);
-                    state->timeout = INVALID_DEFERRED_TOKEN;
+                    smtd_cancel_timeout(state);
+                    break;
                 }
+#if SMTD_CHORDAL_PERMISSIVE
+                // the deferred actions of the keys in between run with the hold
+                smtd_apply_stage(state, SMTD_STAGE_HOLD);
+                smtd_handle_action(state, SMTD_ACTION_HOLD);
+#endif
                 break;
             }
 #endif
@@ -480,12 +1265,19 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
                 state->action_required = -1;
 
                 smtd_handle_action(state, SMTD_ACTION_TOUCH);
+                if (smtd_quick_tap(state)) {
+                    // tap then hold: the hold of the repeated tap starts on the press
+                    smtd_apply_stage(state, SMTD_STAGE_HOLD);
+                    smtd_handle_action(state, SMTD_ACTION_HOLD);
+                    break;
+                }
                 smtd_apply_stage(state, SMTD_STAGE_TOUCH);
                 break;
             }
 
             if (!is_state_key && record->event.pressed) {
                 state->resolution = SMTD_RESOLUTION_DETERMINED;
+                smtd_undetermined_update(state);
                 if (smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS)) {
                     smtd_handle_action(state, SMTD_ACTION_TAP);
                 }
@@ -498,7 +1290,10 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
         // -----------------------------------------------------------------------------------------
         case SMTD_STAGE_HOLD: {
             if (is_state_key && !record->event.pressed) {
-                if (state->idx == smtd_active_states_size - 1) {
+                if (smtd_next(state) == NULL) {
+#if SMTD_ADAPTIVE_TERMS
+                    smtd_adaptive_lone_hold_released(state);
+#endif
                     smtd_handle_action(state, SMTD_ACTION_RELEASE);
                     smtd_apply_stage(state, SMTD_STAGE_NONE);
                     break;
@@ -524,7 +1319,7 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
                 break;
             }
 
-            if (timer_elapsed32(state->released_time) >= state->release_term) {
+            if (smtd_time_reached(smtd_now(), (smtd_time_t) (state->released_time + state->release_term))) {
                 // Timeout has been reached, but timeout_touch_release has not been executed yet
                 SMTD_DEBUG("%s timeout_touch_release has not been executed yet",
                            smtd_state_to_str(state));
@@ -551,6 +1346,9 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
                 smtd_apply_stage(state, SMTD_STAGE_SEQUENCE);
                 break;
             }
+#endif
+#if SMTD_ADAPTIVE_TERMS
+            smtd_adaptive_sample_hold(state);
 #endif
             smtd_apply_stage(state, SMTD_STAGE_HOLD_RELEASE);
             smtd_handle_action(state, SMTD_ACTION_HOLD);
@@ -562,7 +1360,7 @@ void smtd_apply_event(bool is_state_key, smtd_state *state, uint16_t pressed_key
         case SMTD_STAGE_HOLD_RELEASE: {
             // At this stage we have just released the macro key (which was held)
             // and still holding the following key (or keys)
-            if (!record->event.pressed && state->idx != smtd_active_states_size - 1) {
+            if (!record->event.pressed && smtd_next(state) != NULL) {
                 break;
             }
 
@@ -581,29 +1379,129 @@ void reset_state(smtd_state *state) {
     state->pressed_keyposition = MAKE_KEYPOS(0, 0);
     state->pressed_keycode = 0;
     state->desired_keycode = 0;
+#if !SMTD_COMPACT_STATE
+    state->position_keycode = 0;
+    state->position_layer = SMTD_NO_LAYER;
+    memset(state->timeouts, 0, sizeof(state->timeouts));
+    state->features = 0;
+    state->max_tap_count = 0;
+#endif
     state->tap_count = 0;
     state->pressed_time = 0;
     state->released_time = 0;
     state->release_term = 0;
-    state->timeout = INVALID_DEFERRED_TOKEN;
+    state->timeout_at = 0;
+    state->timeout_pending = false;
+    smtd_timeout_dropped(state);
+    state->flow_interrupted = false;
     state->resolution = SMTD_RESOLUTION_UNCERTAIN;
-    state->idx = 0;
+    state->prev = SMTD_NO_LINK;
+    state->next = SMTD_NO_LINK;
+    state->seq = 0;
     state->action_performed = -1;
     state->action_required = -1;
     state->emulated_register = false;
+    state->speculative = false;
+#if SMTD_UNMANAGED_KEYS
+    state->unmanaged = false;
+#endif
 }
 
 void smtd_reset(void) {
+    if (smtd_timer_token != INVALID_DEFERRED_TOKEN) {
+        cancel_deferred_exec(smtd_timer_token);
+        smtd_timer_token = INVALID_DEFERRED_TOKEN;
+    }
+    smtd_timer_dispatching = false;
     for (uint8_t i = 0; i < SMTD_POOL_SIZE; i++) {
-        if (smtd_states_pool[i].timeout != INVALID_DEFERRED_TOKEN) {
-            cancel_deferred_exec(smtd_states_pool[i].timeout);
-        }
         reset_state(&smtd_states_pool[i]);
-        smtd_active_states[i] = NULL;
     }
+    smtd_free_slots_reset();
+    memset(smtd_position_index, 0, sizeof(smtd_position_index));
+    smtd_active_head = NULL;
+    smtd_active_tail = NULL;
     smtd_active_states_size = 0;
+    smtd_active_seq = 0;
+    smtd_undetermined_head = NULL;
+    smtd_timeout_head = NULL;
+    smtd_timeout_head_valid = true;
     smtd_executing_state = NULL;
     smtd_bypass = false;
+    smtd_emulating = false;
+    smtd_output_depth = 0;
+    smtd_report_pending = false;
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_token != INVALID_DEFERRED_TOKEN) {
+        cancel_deferred_exec(smtd_stream_token);
+        smtd_stream_token = INVALID_DEFERRED_TOKEN;
+    }
+    smtd_stream_size = 0;
+#if SMTD_MACRO_STREAM
+    smtd_stream_chars_size = 0;
+#endif
+    smtd_stream_emitting = false;
+    smtd_held_events_size = 0;
+    smtd_held_replaying = false;
+#endif
+#if SMTD_UNMANAGED_KEYS
+    smtd_unmanaged_passed = false;
+#endif
+#if SMTD_LEARN_UNHANDLED
+    memset(smtd_unhandled_keycodes, 0, sizeof(smtd_unhandled_keycodes));
+#endif
+    smtd_flow_streak = false;
+#if SMTD_RHYTHM_MODEL
+    smtd_rhythm_model.typing = false;
+#endif
+#if SMTD_ADAPTIVE_TERMS
+    smtd_adaptive_pending.kind = SMTD_SAMPLE_NONE;
+#endif
+}
+
+void smtd_keymap_changed(void) {
+#if !SMTD_COMPACT_STATE
+    for (smtd_state *state = smtd_active_head; state; state = smtd_next(state)) {
+        state->position_layer = SMTD_NO_LAYER;
+    }
+#endif
+#if SMTD_LEARN_UNHANDLED
+    memset(smtd_unhandled_keycodes, 0, sizeof(smtd_unhandled_keycodes));
+#endif
+}
+
+#ifdef VIA_ENABLE
+// The command is seen before VIA handles it, but nothing reads the keymap
+// until the write is done
+void smtd_via_command(uint8_t *data, uint8_t length) {
+    if (length == 0) return;
+
+    switch (data[0]) {
+        case id_dynamic_keymap_set_keycode:
+        case id_dynamic_keymap_set_buffer:
+        case id_dynamic_keymap_reset:
+        case id_eeprom_reset:
+            smtd_keymap_changed();
+            break;
+        default:
+            break;
+    }
+}
+
+#if SMTD_VIA_KEYMAP_HOOK
+bool via_command_kb(uint8_t *data, uint8_t length) {
+    smtd_via_command(data, length);
+    return false;
+}
+#endif
+#endif
+
+// Whether the tap that just ended is the last one the key tells apart. The taps
+// of a key behind an undecided one wait for it in SMTD_STAGE_SEQUENCE as usual.
+static bool smtd_last_tap(smtd_state *state) {
+    uint8_t max_tap_count = smtd_max_tap_count(state);
+    return max_tap_count > 0 &&
+           state->tap_count + 1 >= max_tap_count &&
+           smtd_worst_resolution_before(state) == SMTD_RESOLUTION_DETERMINED;
 }
 
 void smtd_apply_stage(smtd_state *state, smtd_stage next_stage) {
@@ -611,43 +1509,44 @@ void smtd_apply_stage(smtd_state *state, smtd_stage next_stage) {
                smtd_state_to_str(state),
                smtd_stage_to_str(next_stage));
 
-    deferred_token prev_token = state->timeout;
-    state->timeout = INVALID_DEFERRED_TOKEN;
-    state->stage = next_stage;
+    if (next_stage == SMTD_STAGE_SEQUENCE && !smtd_state_managed(state)) {
+        // nothing counts the taps of an unmanaged key, it is done once released
+        next_stage = SMTD_STAGE_NONE;
+    }
 
-    uint32_t tap_timeout = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP);
-    uint32_t sequence_timeout = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_SEQUENCE);
+    if (next_stage == SMTD_STAGE_SEQUENCE && smtd_last_tap(state)) {
+        // no later tap would mean anything, the sequence is over already
+        if (smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS)) {
+            smtd_handle_action(state, SMTD_ACTION_TAP);
+        }
+        next_stage = SMTD_STAGE_NONE;
+    }
+
+    smtd_cancel_timeout(state);
+    state->stage = next_stage;
+    smtd_undetermined_update(state);
 
     switch (state->stage) {
         case SMTD_STAGE_NONE:
-            // Only unlink if the state is still in the active stack. Guards against
-            // a double removal (e.g. a stale timeout firing for an already-removed
-            // state): without this, smtd_active_states_size-- underflows past 0 and
-            // smtd_active_states[size] = NULL writes out of bounds, corrupting
-            // adjacent memory. Also avoids the unsigned underflow in the loop bound.
-            if (state->idx < smtd_active_states_size && smtd_active_states[state->idx] == state) {
-                for (uint8_t j = state->idx; j + 1 < smtd_active_states_size; j++) {
-                    smtd_active_states[j] = smtd_active_states[j + 1];
-                    smtd_active_states[j]->idx--;
-                }
-
-                smtd_active_states_size--;
-                smtd_active_states[smtd_active_states_size] = NULL;
+            if (smtd_active_unlink(state)) {
+                smtd_return_slot(state);
             }
             reset_state(state);
             break;
 
-        case SMTD_STAGE_TOUCH:
-            state->pressed_time = timer_read32();
-            state->timeout = defer_exec(tap_timeout, timeout_touch, state);
-            SMTD_DEBUG("%s timeout_touch in %lums", smtd_state_to_str(state),
-                       get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP));
+        case SMTD_STAGE_TOUCH: {
+            uint32_t tap_term = smtd_tap_term(state);
+            state->pressed_time = smtd_now();
+            smtd_schedule_timeout(state, tap_term);
+            SMTD_DEBUG("%s timeout_touch in %lums", smtd_state_to_str(state), tap_term);
             break;
+        }
 
         case SMTD_STAGE_SEQUENCE:
-            state->released_time = timer_read32();
+            state->released_time = smtd_now();
             state->resolution = SMTD_RESOLUTION_UNCERTAIN;
-            state->timeout = defer_exec(sequence_timeout, timeout_sequence, state);
+            smtd_undetermined_update(state);
+            smtd_schedule_timeout(state, get_smtd_timeout_or_default(state, SMTD_TIMEOUT_SEQUENCE));
             SMTD_DEBUG("%s timeout_sequence in %lums", smtd_state_to_str(state),
                        get_smtd_timeout_or_default(state, SMTD_TIMEOUT_SEQUENCE));
             break;
@@ -656,27 +1555,27 @@ void smtd_apply_stage(smtd_state *state, smtd_stage next_stage) {
             break;
 
         case SMTD_STAGE_TOUCH_RELEASE:
-            state->released_time = timer_read32();
+            state->released_time = smtd_now();
             state->release_term = smtd_compute_release_term(state);
-            state->timeout = defer_exec(state->release_term, timeout_touch_release, state);
+            smtd_schedule_timeout(state, state->release_term);
             SMTD_DEBUG("%s timeout_touch_release in %lums", smtd_state_to_str(state),
                        state->release_term);
             break;
 
         case SMTD_STAGE_HOLD_RELEASE:
-            state->released_time = timer_read32();
+            state->released_time = smtd_now();
             state->release_term = smtd_compute_release_term(state);
-            state->timeout = defer_exec(state->release_term, timeout_hold_release, state);
+            smtd_schedule_timeout(state, state->release_term);
             SMTD_DEBUG("%s timeout_hold_release in %lums", smtd_state_to_str(state),
                        state->release_term);
             break;
     }
-
-    // need to cancel after creating new timeout. There is a bug in QMK scheduling
-    cancel_deferred_exec(prev_token);
 }
 
-void smtd_handle_action(smtd_state *state, smtd_action action) {
+// Runs a single action of a state unless it is already performed or deferred
+// behind an undetermined earlier state. Returns true when this action made the
+// state determined, i.e. when the deferred actions of following states may run.
+static bool smtd_perform_action(smtd_state *state, smtd_action action) {
     if (state->action_required == -1 || action > state->action_required) {
         state->action_required = action;
     }
@@ -686,14 +1585,14 @@ void smtd_handle_action(smtd_state *state, smtd_action action) {
         SMTD_DEBUG("%s %s is already performed",
                    smtd_state_to_str(state),
                    smtd_action_to_str(action));
-        return;
+        return false;
     }
 
     if (smtd_worst_resolution_before(state) < SMTD_RESOLUTION_DETERMINED) {
         SMTD_DEBUG("%s %s is deferred",
                    smtd_state_to_str(state),
                    smtd_action_to_str(action));
-        return;
+        return false;
     }
 
     SMTD_DEBUG("%s %s processing",
@@ -703,7 +1602,9 @@ void smtd_handle_action(smtd_state *state, smtd_action action) {
     smtd_resolution resolution_before_action = state->resolution;
 
     SMTD_DEBUG_OFFSET_INC;
-    smtd_execute_action(state, action);
+    if (!smtd_speculation_settled(state, action)) {
+        smtd_execute_action(state, action);
+    }
     state->action_performed = action;
     SMTD_DEBUG_OFFSET_DEC;
 
@@ -713,65 +1614,124 @@ void smtd_handle_action(smtd_state *state, smtd_action action) {
         SMTD_DEBUG("%s %s was already determined before",
                    smtd_state_to_str(state),
                    smtd_action_to_str(action));
-        return;
+        return false;
     }
 
     if (resolution_after_action != SMTD_RESOLUTION_DETERMINED) {
         SMTD_DEBUG("%s %s is not yet determined",
                    smtd_state_to_str(state),
                    smtd_action_to_str(action));
-        return;
+        return false;
     }
 
-    for (int i = state->idx + 1; i < smtd_active_states_size; i++) {
-        smtd_state *next_state = smtd_active_states[i];
+    return true;
+}
 
-        SMTD_DEBUG("%s examine %s, action_performed=%d, action_required=%d",
-                   smtd_state_to_str(state),
-                   smtd_state_to_str2(next_state),
-                   next_state->action_performed,
-                   next_state->action_required);
+// A determined state releases the deferred actions of the states that follow it.
+// Each following state replays its actions from TOUCH up to the one it requires,
+// and may become determined itself on the way, which releases the states after
+// it before its own remaining actions run. That nesting is kept in an explicit
+// stack of frames instead of recursion: every frame walks states strictly after
+// the one below it, so the depth (and the stack footprint) is bounded by
+// SMTD_POOL_SIZE no matter how many states resolve at once.
 
-        if (next_state->action_required == -1) {
-            break;
-        }
+typedef struct {
+    /** The following state whose deferred actions are being replayed */
+    smtd_state *next_state;
 
-        if (next_state->action_performed != -1 && next_state->action_performed >= next_state->action_required) {
-            break;
+    /** The last action to replay, taken from action_required on entering the state */
+    smtd_action required_action;
+
+    /** The action of next_state to replay next */
+    smtd_action next_action;
+
+    /** Whether all actions of next_state are replayed and the frame moves on */
+    bool done;
+} smtd_cascade_frame;
+
+static bool smtd_cascade_enter(smtd_cascade_frame *frame, smtd_state *next_state) {
+    if (next_state == NULL) {
+        return false;
+    }
+
+    SMTD_DEBUG("examine %s, action_performed=%d, action_required=%d",
+               smtd_state_to_str(next_state),
+               next_state->action_performed,
+               next_state->action_required);
+
+    if (next_state->action_required == -1) {
+        return false;
+    }
+
+    if (next_state->action_performed != -1 && next_state->action_performed >= next_state->action_required) {
+        return false;
+    }
+
+    SMTD_DEBUG("%s will run deferred actions", smtd_state_to_str(next_state));
+
+    frame->next_state = next_state;
+    frame->required_action = (smtd_action) next_state->action_required;
+    frame->next_action = SMTD_ACTION_TOUCH;
+    frame->done = false;
+    return true;
+}
+
+// The actions replayed for a deferred TAP are TOUCH and TAP, for HOLD and
+// RELEASE they are TOUCH, HOLD (and RELEASE): a hold never comes with a tap
+static smtd_action smtd_cascade_action_after(smtd_action performed, smtd_action required) {
+    if (performed == SMTD_ACTION_TOUCH) {
+        return required == SMTD_ACTION_TAP ? SMTD_ACTION_TAP : SMTD_ACTION_HOLD;
+    }
+    return SMTD_ACTION_RELEASE;
+}
+
+static void smtd_cascade_after(smtd_state *state) {
+    smtd_cascade_frame frames[SMTD_POOL_SIZE];
+    uint8_t depth = 0;
+
+    if (smtd_cascade_enter(&frames[depth], smtd_next(state))) {
+        depth++;
+    }
+
+    while (depth > 0) {
+        smtd_cascade_frame *frame = &frames[depth - 1];
+        smtd_state *next_state = frame->next_state;
+
+        if (frame->done) {
+            // the following states are examined only once the nested frames for
+            // them are finished, so a state is never replayed by two frames
+            if (!smtd_cascade_enter(frame, smtd_next(next_state))) {
+                depth--;
+            }
+            continue;
         }
 
-        SMTD_DEBUG("%s %s will run deferred %s",
-                   smtd_state_to_str(state),
-                   smtd_action_to_str(action),
-                   smtd_state_to_str2(next_state));
+        smtd_action next_action = frame->next_action;
 
         SMTD_DEBUG_OFFSET_INC;
-        switch (next_state->action_required) {
-            case SMTD_ACTION_TOUCH:
-                smtd_handle_action(next_state, SMTD_ACTION_TOUCH);
-                break;
-            case SMTD_ACTION_TAP:
-                smtd_handle_action(next_state, SMTD_ACTION_TOUCH);
-                smtd_handle_action(next_state, SMTD_ACTION_TAP);
-                break;
-            case SMTD_ACTION_HOLD:
-                smtd_handle_action(next_state, SMTD_ACTION_TOUCH);
-                smtd_handle_action(next_state, SMTD_ACTION_HOLD);
-                break;
-            case SMTD_ACTION_RELEASE:
-                smtd_handle_action(next_state, SMTD_ACTION_TOUCH);
-                smtd_handle_action(next_state, SMTD_ACTION_HOLD);
-                smtd_handle_action(next_state, SMTD_ACTION_RELEASE);
-                break;
-        }
+        bool determined = smtd_perform_action(next_state, next_action);
         SMTD_DEBUG_OFFSET_DEC;
 
-        SMTD_DEBUG("%s %s is complete",
-                   smtd_state_to_str(state),
-                   smtd_action_to_str(action));
+        if (next_action >= frame->required_action) {
+            frame->done = true;
+        } else {
+            frame->next_action = smtd_cascade_action_after(next_action, frame->required_action);
+        }
+
+        if (determined && depth < SMTD_POOL_SIZE && smtd_cascade_enter(&frames[depth], smtd_next(next_state))) {
+            depth++;
+        }
     }
 }
 
+void smtd_handle_action(smtd_state *state, smtd_action action) {
+    smtd_output_begin();
+    if (smtd_perform_action(state, action)) {
+        smtd_cascade_after(state);
+    }
+    smtd_output_end();
+}
+
 #if SMTD_ENABLE_QMK_TAPHOLD && defined(IS_QK_MOD_TAP) && defined(IS_QK_LAYER_TAP)
 static uint8_t smtd_qk_mods_8bit(uint16_t keycode) {
     uint8_t mods = mod_config(QK_MOD_TAP_GET_MODS(keycode));
@@ -794,12 +1754,12 @@ static smtd_resolution smtd_handle_qk_tap_hold(uint16_t keycode, smtd_action act
                 SMTD_TAP_16(use_cl, tap_key);
                 return SMTD_RESOLUTION_DETERMINED;
             case SMTD_ACTION_HOLD:
-                register_mods(mods);
-                send_keyboard_report();
+                add_mods(mods);
+                smtd_send_report();
                 return SMTD_RESOLUTION_DETERMINED;
             case SMTD_ACTION_RELEASE:
-                unregister_mods(mods);
-                send_keyboard_report();
+                del_mods(mods);
+                smtd_send_report();
                 return SMTD_RESOLUTION_DETERMINED;
         }
     }
@@ -826,32 +1786,68 @@ static smtd_resolution smtd_handle_qk_tap_hold(uint16_t keycode, smtd_action act
 }
 #endif
 
+// Looks up the keycode of a state whose actions were deferred, on the layer
+// its first action runs on, and re-arms the touch timeout with its tap term
+static void smtd_resolve_keycode(smtd_state *state) {
+    state->desired_keycode = smtd_position_keycode(state);
+#if SMTD_UNMANAGED_KEYS
+    // the key was found unmanaged by its keycode on the press-time layer
+    if (state->unmanaged && state->desired_keycode != state->pressed_keycode) {
+        state->unmanaged = smtd_key_unmanaged(state->pressed_keyposition, state->desired_keycode);
+    }
+#endif
+    if (state->desired_keycode == 0) return;
+
+    smtd_take_snapshot(state, state->desired_keycode);
+    if (state->stage == SMTD_STAGE_TOUCH && state->timeout_pending) {
+        smtd_time_t deadline = (smtd_time_t) (state->pressed_time + smtd_tap_term(state));
+        smtd_schedule_timeout(state, smtd_time_reached(smtd_now(), deadline)
+                                     ? 0
+                                     : (smtd_time_t) (deadline - smtd_now()));
+    }
+}
+
 void smtd_execute_action(smtd_state *state, smtd_action action) {
     if (state->desired_keycode == 0) {
-        state->desired_keycode = smtd_current_keycode(&state->pressed_keyposition);
+        smtd_resolve_keycode(state);
     }
 
     SMTD_DEBUG("%s exec in progress with %s",
                smtd_state_to_str(state),
                smtd_action_to_str(action));
 
-    smtd_state *prev_executing_state = smtd_executing_state;
-    smtd_executing_state = state;
-    smtd_bypass = true;
-    smtd_resolution new_resolution = on_smtd_action(state->desired_keycode, action, state->tap_count);
+    smtd_resolution new_resolution = SMTD_RESOLUTION_UNHANDLED;
+    if (smtd_state_managed(state)) {
+        smtd_state *prev_executing_state = smtd_executing_state;
+        smtd_executing_state = state;
+        smtd_bypass = true;
+        new_resolution = on_smtd_action(state->desired_keycode, action, state->tap_count);
 
 #if SMTD_ENABLE_QMK_TAPHOLD && defined(IS_QK_MOD_TAP) && defined(IS_QK_LAYER_TAP)
-    if (new_resolution == SMTD_RESOLUTION_UNHANDLED) {
-        new_resolution = smtd_handle_qk_tap_hold(state->desired_keycode, action);
-    }
+        if (new_resolution == SMTD_RESOLUTION_UNHANDLED) {
+            new_resolution = smtd_handle_qk_tap_hold(state->desired_keycode, action);
+        }
 #endif
-    smtd_bypass = false;
-    smtd_executing_state = prev_executing_state;
 
-    SMTD_SIMULTANEOUS_PRESSES_DELAY
+#if SMTD_LEARN_UNHANDLED
+        // Every sm_td macro answers the first touch, so an unhandled one marks a
+        // plain key. Only keycodes QMK itself resolves for the press are learned,
+        // since that is what the next press is looked up by.
+        if (action == SMTD_ACTION_TOUCH && state->tap_count == 0 &&
+            new_resolution == SMTD_RESOLUTION_UNHANDLED &&
+            state->desired_keycode == state->pressed_keycode) {
+            smtd_learn_unhandled(state->desired_keycode);
+        }
+#endif
+        smtd_bypass = false;
+        smtd_executing_state = prev_executing_state;
+    }
+
     if (new_resolution > state->resolution) {
         state->resolution = new_resolution;
+        smtd_undetermined_update(state);
     }
+    smtd_flow_track(state, action, new_resolution);
 
     if (new_resolution == SMTD_RESOLUTION_UNHANDLED) {
         SMTD_DEBUG_OFFSET_INC;
@@ -859,6 +1855,7 @@ void smtd_execute_action(smtd_state *state, smtd_action action) {
             case SMTD_ACTION_TOUCH:
                 smtd_emulate_key(&state->pressed_keyposition, true);
                 state->resolution = SMTD_RESOLUTION_DETERMINED;
+                smtd_undetermined_update(state);
                 break;
             case SMTD_ACTION_TAP:
                 smtd_emulate_key(&state->pressed_keyposition, false);
@@ -881,19 +1878,45 @@ void smtd_execute_action(smtd_state *state, smtd_action action) {
  *      UTILITY FUNCTIONS                *
  * ************************************* */
 
+// The keycode at a position, taken from the cache of the state pressed there
+static inline uint16_t smtd_keypos_keycode(keypos_t *keypos) {
+    smtd_state *owner = smtd_position_indexed(*keypos) ? smtd_position_owner(*keypos) : NULL;
+    return owner != NULL ? smtd_position_keycode(owner) : smtd_current_keycode(keypos);
+}
+
 void smtd_emulate_key(keypos_t *keypos, bool press) {
+    smtd_output_flush();
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_queues_output()) {
+        SMTD_DEBUG("--> STREAM %s %s", press ? "PRESS" : "RELEASE",
+                   smtd_keycode_to_str(smtd_keypos_keycode(keypos)));
+        smtd_stream_item item =
+            smtd_stream_own_output(press ? SMTD_STREAM_EMULATE_PRESS : SMTD_STREAM_EMULATE_RELEASE);
+        item.key = *keypos;
+        smtd_stream_push(item);
+        return;
+    }
+#endif
+
     SMTD_DEBUG("--> EMULATE %s %s", press ? "PRESS" : "RELEASE",
-               smtd_keycode_to_str(smtd_current_keycode(keypos)));
+               smtd_keycode_to_str(smtd_keypos_keycode(keypos)));
     bool bypass_before = smtd_bypass;
+    bool emulating_before = smtd_emulating;
     smtd_bypass = true;
+    smtd_emulating = true;
     //fixme-sm how to emulate keypresses with row,col = (0,0) // like combos for example
     keyevent_t event_press = MAKE_KEYEVENT(keypos->row, keypos->col, press);
     keyrecord_t record_press = {.event = event_press};
+    smtd_output_sent();
     SMTD_DEBUG_OFFSET_INC;
     process_record(&record_press);
     SMTD_DEBUG_OFFSET_DEC;
+    smtd_emulating = emulating_before;
     smtd_bypass = bypass_before;
-    SMTD_SIMULTANEOUS_PRESSES_DELAY
+}
+
+bool smtd_is_emulating(void) {
+    return smtd_emulating;
 }
 
 /* ************************************* *
@@ -937,7 +1960,7 @@ static bool smtd_pipeline_emulation_allowed(bool use_cl, uint16_t key) {
     // possible while the keymap still resolves the pressed position to the
     // requested key. Derived keycodes (e.g. alternate multi-tap keys) and
     // custom macro keycodes fail this check and are sent directly.
-    return smtd_current_keycode(&smtd_executing_state->pressed_keyposition) == key;
+    return smtd_position_keycode(smtd_executing_state) == key;
 }
 
 #ifdef LEADER_ENABLE
@@ -982,6 +2005,16 @@ void smtd_tap_code16(bool use_cl, uint16_t key) {
     #ifdef CAPS_WORD_ENABLE
     if (!smtd_process_caps_word(use_cl, key)) return;
     #endif
+    smtd_output_flush();
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_queues_output()) {
+        smtd_stream_item item = smtd_stream_own_output(SMTD_STREAM_TAP);
+        item.keycode = key;
+        smtd_stream_push(item);
+        return;
+    }
+#endif
+    smtd_output_sent();
     tap_code16(key);
 }
 
@@ -995,6 +2028,16 @@ void smtd_register_code16(bool use_cl, uint16_t key) {
     #ifdef CAPS_WORD_ENABLE
     if (!smtd_process_caps_word(use_cl, key)) return;
     #endif
+    smtd_output_flush();
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_queues_output()) {
+        smtd_stream_item item = smtd_stream_own_output(SMTD_STREAM_REGISTER);
+        item.keycode = key;
+        smtd_stream_push(item);
+        return;
+    }
+#endif
+    smtd_output_sent();
     register_code16(key);
 }
 
@@ -1008,19 +2051,25 @@ void smtd_unregister_code16(bool use_cl, uint16_t key) {
         return;
     }
 
+    smtd_output_flush();
+#if SMTD_OUTPUT_QUEUE
+    if (smtd_stream_queues_output()) {
+        smtd_stream_item item = smtd_stream_own_output(SMTD_STREAM_UNREGISTER);
+        item.keycode = key;
+        smtd_stream_push(item);
+        return;
+    }
+#endif
+    smtd_output_sent();
     unregister_code16(key);
 }
 
 smtd_resolution smtd_worst_resolution_before(smtd_state *state) {
+    // Only the first undetermined state matters: if it comes before this one,
+    // its resolution is below DETERMINED, otherwise everything before is settled
     smtd_resolution result = SMTD_RESOLUTION_DETERMINED;
-    for (uint8_t i = 0; i < state->idx; i++) {
-        if (smtd_active_states[i]->stage == SMTD_STAGE_SEQUENCE) {
-            continue;
-        }
-
-        if (smtd_active_states[i]->resolution < result) {
-            result = smtd_active_states[i]->resolution;
-        }
+    if (smtd_undetermined_head != NULL && smtd_undetermined_head->seq < state->seq) {
+        result = smtd_undetermined_head->resolution;
     }
 
     SMTD_DEBUG("worst_resolution_before: %s result %d",
@@ -1029,10 +2078,11 @@ smtd_resolution smtd_worst_resolution_before(smtd_state *state) {
 }
 
 uint32_t get_smtd_timeout_or_default(smtd_state *state, smtd_timeout timeout) {
-    if (get_smtd_timeout) {
-        return get_smtd_timeout(state->desired_keycode, timeout);
-    }
-    return get_smtd_timeout_default(timeout);
+#if SMTD_COMPACT_STATE
+    return smtd_eval_timeout(state, smtd_hook_keycode(state), timeout);
+#else
+    return state->timeouts[timeout];
+#endif
 }
 
 uint32_t get_smtd_timeout_default(smtd_timeout timeout) {
@@ -1043,27 +2093,47 @@ uint32_t get_smtd_timeout_default(smtd_timeout timeout) {
             return SMTD_GLOBAL_SEQUENCE_TERM;
         case SMTD_TIMEOUT_RELEASE:
             return SMTD_GLOBAL_RELEASE_TERM;
+        case SMTD_TIMEOUT_FLOW_TAP:
+            return SMTD_GLOBAL_FLOW_TAP_TERM;
     }
     return 0;
 }
 
+#if SMTD_GLOBAL_RELEASE_PERCENT > 0
+// The shorter of the pause between both presses (p1) and the overlap until the
+// state's key was released (p2)
+static uint32_t smtd_min_pause(smtd_state *state, smtd_state *next) {
+    smtd_time_diff_t p1 = (smtd_time_diff_t) (next->pressed_time - state->pressed_time);
+    smtd_time_diff_t p2 = (smtd_time_diff_t) (state->released_time - next->pressed_time);
+    // events of the other split half may be moved back behind earlier ones
+    if (p1 < 0) p1 = 0;
+    if (p2 < 0) p2 = 0;
+#if SMTD_RHYTHM_MODEL
+    smtd_rhythm_smooth(&p1, &p2);
+#endif
+    return (uint32_t) (p1 < p2 ? p1 : p2);
+}
+#endif
+
 uint32_t smtd_compute_release_term(smtd_state *state) {
     uint32_t fixed_term = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_RELEASE);
 
 #if SMTD_GLOBAL_RELEASE_PERCENT > 0
     // SMTD_STAGE_TOUCH_RELEASE is only entered while a following key is still
     // pressed, so the next state must exist; fall back to the fixed term just in case.
-    if (state->idx + 1 >= smtd_active_states_size) {
+    smtd_state *next = smtd_next(state);
+    if (next == NULL) {
         return fixed_term;
     }
 
-    smtd_state *next = smtd_active_states[state->idx + 1];
-    uint32_t p1 = next->pressed_time - state->pressed_time;
-    uint32_t p2 = state->released_time - next->pressed_time;
-    uint32_t min_pause = (p1 < p2 ? p1 : p2);
+#if SMTD_ADAPTIVE_TERMS
+    uint32_t percent = smtd_adaptive_release_percent(state);
+#else
+    uint32_t percent = SMTD_GLOBAL_RELEASE_PERCENT;
+#endif
     // multiply before dividing to keep precision for fractional ratios; min_pause
     // is a sub-second overlap here, so min_pause * percent never overflows uint32_t
-    uint32_t term = min_pause * SMTD_GLOBAL_RELEASE_PERCENT / 100;
+    uint32_t term = smtd_min_pause(state, next) * percent / 100;
 
     // defer_exec rejects a zero delay, and the fixed term must stay the upper
     // bound so the dynamic window can only shrink relative to the old behavior
@@ -1080,11 +2150,29 @@ uint16_t smtd_current_keycode(keypos_t *key) {
     return keymap_key_to_keycode(current_layer, *key);
 }
 
-bool smtd_feature_enabled_or_default(smtd_state *state, smtd_feature feature) {
-    if (smtd_feature_enabled) {
-        return smtd_feature_enabled(state->desired_keycode, feature);
+// Same as smtd_current_keycode for the state's pressed position, but the keymap
+// is only read again after the highest layer changes. With VIA / Vial the
+// keymap lives in (emulated) EEPROM, and this runs on every tap. The compact
+// layout has no room for the cache and reads the keymap every time.
+uint16_t smtd_position_keycode(smtd_state *state) {
+#if SMTD_COMPACT_STATE
+    return smtd_current_keycode(&state->pressed_keyposition);
+#else
+    uint8_t current_layer = get_highest_layer(layer_state);
+    if (state->position_layer != current_layer) {
+        state->position_keycode = keymap_key_to_keycode(current_layer, state->pressed_keyposition);
+        state->position_layer = current_layer;
     }
-    return smtd_feature_enabled_default(state->desired_keycode, feature);
+    return state->position_keycode;
+#endif
+}
+
+bool smtd_feature_enabled_or_default(smtd_state *state, smtd_feature feature) {
+#if SMTD_COMPACT_STATE
+    return smtd_eval_feature(state, smtd_hook_keycode(state), feature);
+#else
+    return (state->features >> feature) & 1;
+#endif
 }
 
 bool smtd_feature_enabled_default(uint16_t keycode, smtd_feature feature) {
@@ -1093,10 +2181,632 @@ bool smtd_feature_enabled_default(uint16_t keycode, smtd_feature feature) {
             return SMTD_GLOBAL_AGGREGATE_TAPS;
         case SMTD_FEATURE_PIPELINE_TAPS:
             return SMTD_GLOBAL_PIPELINE_TAPS;
+        case SMTD_FEATURE_SPECULATIVE_TAPS:
+            return SMTD_GLOBAL_SPECULATIVE_TAPS;
+        case SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS:
+            return SMTD_GLOBAL_HOLD_ON_OTHER_KEY_PRESS;
+        case SMTD_FEATURE_QUICK_TAP:
+            return SMTD_GLOBAL_QUICK_TAP;
     }
     return false;
 }
 
+/* ************************************* *
+ *             MACRO STREAM              *
+ * ************************************* */
+
+#if SMTD_OUTPUT_QUEUE
+
+#if SMTD_MACRO_STREAM
+_Static_assert(SMTD_STREAM_CHARS_SIZE > 0 && SMTD_STREAM_CHARS_SIZE <= 255,
+               "SMTD_STREAM_CHARS_SIZE must be between 1 and 255");
+#endif
+
+// Output sm_td sends itself is queued while a stream is running, except for the
+// stream's own steps, and while the simultaneous presses delay since the last
+// output has not passed yet
+static bool smtd_stream_queues_output(void) {
+    if (smtd_stream_emitting) return false;
+    if (smtd_stream_size > 0) return true;
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+    return timer_elapsed32(smtd_output_sent_at) < SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS;
+#else
+    return false;
+#endif
+}
+
+// The time until the next step may go out
+static uint32_t smtd_stream_delay(void) {
+    uint32_t delay = SMTD_STREAM_INTERVAL_MS;
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+    uint32_t elapsed = timer_elapsed32(smtd_output_sent_at);
+    if (elapsed < SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS &&
+        SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS - elapsed > delay) {
+        delay = SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS - elapsed;
+    }
+#endif
+    return delay;
+}
+
+// Output sm_td queues itself goes out with the mods and layers of the moment it
+// was queued, since later actions of the same cascade change them right away
+static smtd_stream_item smtd_stream_own_output(smtd_stream_kind kind) {
+    return (smtd_stream_item) {
+        .kind = kind,
+        .queued_state = true,
+        .mods = get_mods(),
+        .weak_mods = get_weak_mods(),
+        .layers = layer_state,
+    };
+}
+
+// The live bits with the changes an output made on top of its queued bits
+static uint32_t smtd_stream_keep_changes(uint32_t live, uint32_t queued, uint32_t after) {
+    return (live | (after & ~queued)) & ~(queued & ~after);
+}
+
+// Sends one character or keycode of the oldest item, and drops the item once done
+static void smtd_stream_step(void) {
+    smtd_stream_item *item = &smtd_stream[smtd_stream_head];
+    uint8_t live_mods = get_mods();
+    uint8_t live_weak_mods = get_weak_mods();
+    layer_state_t live_layers = layer_state;
+    if (item->queued_state) {
+        set_mods(item->mods);
+        set_weak_mods(item->weak_mods);
+        layer_state = item->layers;
+    }
+
+    // the same context on_smtd_action output is sent from
+    bool bypass_before = smtd_bypass;
+    smtd_bypass = true;
+    smtd_stream_emitting = true;
+    smtd_output_sent();
+    switch (item->kind) {
+        case SMTD_STREAM_STRING:
+#if SMTD_MACRO_STREAM
+            if (item->length > 0) {
+                send_char(smtd_stream_chars[smtd_stream_chars_head]);
+                smtd_stream_chars_head = (smtd_stream_chars_head + 1) % SMTD_STREAM_CHARS_SIZE;
+                smtd_stream_chars_size--;
+                item->length--;
+            }
+#endif
+            break;
+        case SMTD_STREAM_TAP:
+            tap_code16(item->keycode);
+            break;
+        case SMTD_STREAM_REGISTER:
+            register_code16(item->keycode);
+            break;
+        case SMTD_STREAM_UNREGISTER:
+            unregister_code16(item->keycode);
+            break;
+        case SMTD_STREAM_EMULATE_PRESS:
+        case SMTD_STREAM_EMULATE_RELEASE:
+            smtd_emulate_key(&item->key, item->kind == SMTD_STREAM_EMULATE_PRESS);
+            break;
+        case SMTD_STREAM_REPORT:
+            send_keyboard_report();
+            break;
+    }
+    smtd_stream_emitting = false;
+    smtd_bypass = bypass_before;
+
+    if (item->queued_state) {
+        set_mods((uint8_t) smtd_stream_keep_changes(live_mods, item->mods, get_mods()));
+        set_weak_mods((uint8_t) smtd_stream_keep_changes(live_weak_mods, item->weak_mods, get_weak_mods()));
+        layer_state = (layer_state_t) smtd_stream_keep_changes(live_layers, item->layers, layer_state);
+    }
+
+    if (item->kind == SMTD_STREAM_STRING && item->length > 0) return;
+    smtd_stream_head = (smtd_stream_head + 1) % SMTD_STREAM_SIZE;
+    smtd_stream_size--;
+}
+
+// Key events held behind the stream are processed once it has run out, in their
+// order, until one of them starts a new stream
+static void smtd_held_events_replay(void) {
+    while (smtd_held_events_size > 0 && smtd_stream_size == 0) {
+        smtd_held_event held = smtd_held_events[0];
+        smtd_held_events_size--;
+        memmove(&smtd_held_events[0], &smtd_held_events[1], smtd_held_events_size * sizeof(smtd_held_event));
+
+        smtd_held_replaying = true;
+        bool pass = smtd_process_desired(held.pressed_keycode, &held.record, held.desired_keycode);
+        smtd_held_replaying = false;
+
+        // the event has passed the hooks in front of sm_td already, only QMK's
+        // handling of the key itself is left
+        if (pass) {
+            smtd_emulate_key(&held.record.event.key, held.record.event.pressed);
+        }
+    }
+}
+
+static uint32_t smtd_stream_tick(uint32_t trigger_time, void *cb_arg) {
+    smtd_output_begin();
+    if (smtd_stream_size > 0) {
+        smtd_stream_step();
+    }
+    if (smtd_stream_size == 0) {
+        smtd_held_events_replay();
+    }
+    smtd_output_end();
+
+    if (smtd_stream_size > 0) {
+        return smtd_stream_delay();
+    }
+    smtd_stream_token = INVALID_DEFERRED_TOKEN;
+    return 0;
+}
+
+// Sends the whole stream and the events held behind it right away
+static void smtd_stream_drain(void) {
+    while (smtd_stream_size > 0) {
+        while (smtd_stream_size > 0) {
+            smtd_stream_step();
+        }
+        smtd_held_events_replay();
+    }
+}
+
+static void smtd_stream_push(smtd_stream_item item) {
+    // a full stream sends its oldest steps early rather than dropping output
+    while (smtd_stream_size == SMTD_STREAM_SIZE) {
+        smtd_stream_step();
+    }
+
+    smtd_stream[(smtd_stream_head + smtd_stream_size) % SMTD_STREAM_SIZE] = item;
+    smtd_stream_size++;
+
+    if (smtd_stream_token == INVALID_DEFERRED_TOKEN) {
+        smtd_stream_token = defer_exec(smtd_stream_delay(), smtd_stream_tick, NULL);
+    }
+}
+
+static bool smtd_stream_holds(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode) {
+    if (smtd_held_replaying || smtd_stream_size == 0) return false;
+
+    if (smtd_held_events_size == SMTD_STREAM_HELD_SIZE) {
+        smtd_stream_drain();
+        return false;
+    }
+
+    smtd_held_events[smtd_held_events_size++] = (smtd_held_event) {
+        .pressed_keycode = pressed_keycode,
+        .desired_keycode = desired_keycode,
+        .record = *record,
+    };
+    return true;
+}
+
+#if SMTD_MACRO_STREAM
+
+// The string is copied in pieces that fit the free characters, a full buffer
+// sends its oldest steps early like a full stream does
+void smtd_stream_string(const char *str) {
+    if (str == NULL) return;
+    while (*str != '\0') {
+        if (smtd_stream_chars_size == SMTD_STREAM_CHARS_SIZE) {
+            smtd_stream_step();
+            continue;
+        }
+
+        uint8_t length = 0;
+        while (str[length] != '\0' && smtd_stream_chars_size < SMTD_STREAM_CHARS_SIZE) {
+            uint8_t tail = (smtd_stream_chars_head + smtd_stream_chars_size) % SMTD_STREAM_CHARS_SIZE;
+            smtd_stream_chars[tail] = str[length];
+            smtd_stream_chars_size++;
+            length++;
+        }
+        str += length;
+        smtd_stream_push((smtd_stream_item) {.kind = SMTD_STREAM_STRING, .length = length});
+    }
+}
+
+void smtd_stream_tap(uint16_t keycode) {
+    smtd_stream_push((smtd_stream_item) {.kind = SMTD_STREAM_TAP, .keycode = keycode});
+}
+
+bool smtd_stream_active(void) {
+    return smtd_stream_size > 0;
+}
+
+#endif
+
+#endif
+
+/* ************************************* *
+ *             RHYTHM MODEL              *
+ * ************************************* */
+
+#if SMTD_RHYTHM_MODEL
+
+static void smtd_rhythm_sample(uint16_t *average, smtd_time_diff_t sample_ms) {
+    if (sample_ms < 0 || sample_ms > SMTD_RHYTHM_MAX_GAP_MS) return;
+
+    int32_t sample = (int32_t) sample_ms * 8;
+    if (*average == 0) {
+        *average = sample > 0 ? (uint16_t) sample : 1;
+        return;
+    }
+    int32_t updated = *average + (sample - *average) / (1 << SMTD_RHYTHM_SHIFT);
+    *average = updated > 0 ? (uint16_t) updated : 1;
+}
+
+// Every press is an interval sample. A key released while the last pressed one
+// is still down was rolled over, the time since that last press is an overlap
+// sample. Once the last key is up, e.g. for the mod of ↓Ctrl ↓C ↑C ↑Ctrl, a
+// release overlaps nothing.
+static void smtd_rhythm_event(keyrecord_t *record) {
+    smtd_rhythm *model = &smtd_rhythm_model;
+    smtd_time_diff_t since_press = (smtd_time_diff_t) (smtd_now() - model->last_press);
+    bool last_key = record->event.key.row == model->last_key.row &&
+                    record->event.key.col == model->last_key.col;
+
+    if (record->event.pressed) {
+        if (model->typing) {
+            smtd_rhythm_sample(&model->interval, since_press);
+        }
+        model->last_press = smtd_now();
+        model->last_key = record->event.key;
+        model->last_down = true;
+        model->typing = true;
+    } else if (last_key) {
+        model->last_down = false;
+    } else if (model->typing && model->last_down) {
+        smtd_rhythm_sample(&model->overlap, since_press);
+    }
+}
+
+// Moves p1 and p2 of the pair being decided halfway to the recent averages
+static void smtd_rhythm_smooth(smtd_time_diff_t *p1, smtd_time_diff_t *p2) {
+    smtd_rhythm *model = &smtd_rhythm_model;
+    if (model->interval == 0 || model->overlap == 0) return;
+
+    *p1 = (smtd_time_diff_t) ((*p1 + model->interval / 8) / 2);
+    *p2 = (smtd_time_diff_t) ((*p2 + model->overlap / 8) / 2);
+}
+
+#endif
+
+/* ************************************* *
+ *           SPECULATIVE TAPS            *
+ * ************************************* */
+
+static void smtd_speculative_count(uint16_t *counter) {
+    if (*counter < UINT16_MAX) (*counter)++;
+}
+
+// Sends the tap of a just touched key right away. Only a key that is the first
+// undecided one may do that, output of later keys would overtake it otherwise.
+// Tap sequences and aggregated taps are left to the regular path.
+static void smtd_speculate_tap(smtd_state *state) {
+    if (!smtd_feature_enabled_or_default(state, SMTD_FEATURE_SPECULATIVE_TAPS) ||
+        smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS) ||
+        !smtd_state_managed(state) ||
+        state->tap_count > 0 ||
+        state->stage != SMTD_STAGE_TOUCH ||
+        state->action_performed != SMTD_ACTION_TOUCH ||
+        state->resolution != SMTD_RESOLUTION_UNCERTAIN ||
+        smtd_worst_resolution_before(state) < SMTD_RESOLUTION_DETERMINED) {
+        return;
+    }
+
+    SMTD_DEBUG("%s speculative TAP", smtd_state_to_str(state));
+    SMTD_DEBUG_OFFSET_INC;
+    smtd_output_begin();
+    smtd_execute_action(state, SMTD_ACTION_TAP);
+    smtd_output_end();
+    SMTD_DEBUG_OFFSET_DEC;
+
+    // the key is still undecided, the tap above is only a guess
+    state->resolution = SMTD_RESOLUTION_UNCERTAIN;
+    smtd_undetermined_update(state);
+    state->speculative = true;
+    smtd_speculative_count(&smtd_speculative.taps);
+}
+
+// Settles a speculative tap once the key is decided. A tap was sent already, so
+// the action only marks the state determined. Anything else takes the tap back
+// first. Returns true when the action must not be executed again.
+static bool smtd_speculation_settled(smtd_state *state, smtd_action action) {
+    if (!state->speculative) return false;
+    state->speculative = false;
+
+    if (action == SMTD_ACTION_TAP) {
+        SMTD_DEBUG("%s speculative TAP confirmed", smtd_state_to_str(state));
+        state->resolution = SMTD_RESOLUTION_DETERMINED;
+        smtd_undetermined_update(state);
+        return true;
+    }
+
+    SMTD_DEBUG("%s speculative TAP rolled back", smtd_state_to_str(state));
+    smtd_speculative_count(&smtd_speculative.rollbacks);
+    smtd_state *prev_executing_state = smtd_executing_state;
+    smtd_executing_state = state;
+    smtd_bypass = true;
+    smtd_tap_code16(false, SMTD_SPECULATIVE_CORRECTION);
+    smtd_bypass = false;
+    smtd_executing_state = prev_executing_state;
+    return false;
+}
+
+smtd_speculative_stats smtd_get_speculative_stats(void) {
+    return smtd_speculative;
+}
+
+/* ************************************* *
+ *              FLOW TAPS                *
+ * ************************************* */
+
+// A sent tap (or the press of a plain key) starts or extends the typing streak,
+// a hold ends it
+static void smtd_flow_track(smtd_state *state, smtd_action action, smtd_resolution resolution) {
+    bool tapped = resolution == SMTD_RESOLUTION_UNHANDLED
+                  ? action == SMTD_ACTION_TOUCH
+                  : action == SMTD_ACTION_TAP && resolution == SMTD_RESOLUTION_DETERMINED;
+    if (tapped) {
+        smtd_flow_streak = true;
+        smtd_flow_tap_at = smtd_now();
+    } else if (action == SMTD_ACTION_HOLD && resolution == SMTD_RESOLUTION_DETERMINED) {
+        smtd_flow_streak = false;
+    }
+}
+
+// An unmanaged key passed to QMK without a state is typed like any plain key
+static void smtd_flow_pass(void) {
+    smtd_flow_streak = true;
+    smtd_flow_tap_at = smtd_now();
+}
+
+// Resolves a just touched key as a tap when it was pressed during a typing
+// streak. The state stays in SMTD_STAGE_TOUCH without a timeout until the key is
+// released and then waits in SMTD_STAGE_SEQUENCE, so a quick second tap still
+// counts as a tap sequence however long the first one was held.
+// Plain keys are determined by their touch already and are left alone.
+// Returns true when the key was tapped.
+static bool smtd_flow_tap(smtd_state *state) {
+    uint32_t flow_term = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_FLOW_TAP);
+    if (flow_term == 0 || !smtd_flow_streak ||
+        !smtd_state_managed(state) ||
+        state->tap_count > 0 ||
+        state->stage != SMTD_STAGE_TOUCH ||
+        state->action_performed != SMTD_ACTION_TOUCH ||
+        state->resolution != SMTD_RESOLUTION_UNCERTAIN ||
+        smtd_feature_enabled_or_default(state, SMTD_FEATURE_AGGREGATE_TAPS) ||
+        smtd_worst_resolution_before(state) < SMTD_RESOLUTION_DETERMINED) {
+        return false;
+    }
+
+    smtd_time_diff_t since_tap = (smtd_time_diff_t) (smtd_now() - smtd_flow_tap_at);
+    if (since_tap < 0 || (uint32_t) since_tap >= flow_term) {
+        return false;
+    }
+
+    SMTD_DEBUG("%s flow TAP, %dms after the last tap", smtd_state_to_str(state), (int) since_tap);
+    smtd_cancel_timeout(state);
+    smtd_handle_action(state, SMTD_ACTION_TAP);
+    return true;
+}
+
+/* ************************************* *
+ *            ADAPTIVE TERMS             *
+ * ************************************* */
+
+#if SMTD_ADAPTIVE_TERMS
+
+#if defined(EECONFIG_USER_DATA_SIZE) && EECONFIG_USER_DATA_SIZE > 0
+_Static_assert(SMTD_ADAPTIVE_EEPROM_OFFSET + sizeof(smtd_adaptive_terms) <= EECONFIG_USER_DATA_SIZE,
+               "EECONFIG_USER_DATA_SIZE is too small for the SMTD_ADAPTIVE_TERMS table");
+#endif
+
+__attribute__((weak)) void smtd_adaptive_load(void *data, uint16_t size) {
+#if defined(EECONFIG_USER_DATA_SIZE) && EECONFIG_USER_DATA_SIZE > 0
+    eeconfig_read_user_datablock(data, SMTD_ADAPTIVE_EEPROM_OFFSET, size);
+#else
+    memset(data, 0, size);
+#endif
+}
+
+__attribute__((weak)) void smtd_adaptive_save(const void *data, uint16_t size) {
+#if defined(EECONFIG_USER_DATA_SIZE) && EECONFIG_USER_DATA_SIZE > 0
+    eeconfig_update_user_datablock(data, SMTD_ADAPTIVE_EEPROM_OFFSET, size);
+#endif
+}
+
+// The table is read from EEPROM on first use. Positions outside the matrix
+// (records made up by other features) have no entry.
+static smtd_adaptive_term *smtd_adaptive_entry(keypos_t key) {
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) return NULL;
+    if (!smtd_adaptive_loaded) {
+        smtd_adaptive_load(smtd_adaptive_terms, sizeof(smtd_adaptive_terms));
+        smtd_adaptive_loaded = true;
+    }
+    return &smtd_adaptive_terms[key.row][key.col];
+}
+
+static uint32_t smtd_adaptive_tap_term(smtd_state *state) {
+    uint32_t configured = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP);
+    smtd_adaptive_term *term = smtd_state_managed(state) ? smtd_adaptive_entry(state->pressed_keyposition) : NULL;
+    if (term == NULL || term->tap_term == 0) return configured;
+
+    uint32_t learned = (uint32_t) term->tap_term * 2;
+    if (learned < SMTD_ADAPTIVE_MIN_TAP_TERM) learned = SMTD_ADAPTIVE_MIN_TAP_TERM;
+    return learned < configured ? learned : configured;
+}
+
+static uint32_t smtd_adaptive_release_percent(smtd_state *state) {
+    smtd_adaptive_term *term = smtd_state_managed(state) ? smtd_adaptive_entry(state->pressed_keyposition) : NULL;
+    if (term == NULL || term->release_percent == 0 || term->release_percent > SMTD_GLOBAL_RELEASE_PERCENT) {
+        return SMTD_GLOBAL_RELEASE_PERCENT;
+    }
+    return term->release_percent;
+}
+
+static uint32_t smtd_adaptive_save_tick(uint32_t trigger_time, void *cb_arg) {
+    smtd_adaptive_save_token = INVALID_DEFERRED_TOKEN;
+    smtd_adaptive_save(smtd_adaptive_terms, sizeof(smtd_adaptive_terms));
+    return 0;
+}
+
+// Moves a learned value toward the target: right away when the target is wider
+// (the decision came closer to the edge than the margin allows), and gradually
+// when it is tighter. Returns 0 once the value is back at the configured bound.
+static uint16_t smtd_adaptive_move(uint16_t current, uint16_t target, uint16_t lower, uint16_t upper) {
+    if (current == 0 || current > upper) current = upper;
+    if (target >= current) {
+        current = target;
+    } else {
+        current -= (current - target + SMTD_ADAPTIVE_RATE - 1) / SMTD_ADAPTIVE_RATE;
+    }
+    if (current < lower) current = lower;
+    return current >= upper ? 0 : current;
+}
+
+static void smtd_adaptive_learn(smtd_adaptive_sample *sample) {
+    smtd_adaptive_term *term = smtd_adaptive_entry(sample->key);
+    if (term == NULL) return;
+
+    smtd_adaptive_term learned = *term;
+    if (sample->kind == SMTD_SAMPLE_HOLD) {
+        learned.release_percent = (uint8_t) smtd_adaptive_move(term->release_percent,
+                                                               sample->value + SMTD_ADAPTIVE_RELEASE_MARGIN,
+                                                               1, SMTD_GLOBAL_RELEASE_PERCENT);
+    } else {
+        uint16_t tap_term = smtd_adaptive_move(term->tap_term * 2, sample->value + SMTD_ADAPTIVE_TAP_MARGIN_MS,
+                                               SMTD_ADAPTIVE_MIN_TAP_TERM, sample->tap_term);
+        // a term that doesn't fit the table falls back to the configured one
+        learned.tap_term = tap_term / 2 > UINT8_MAX ? 0 : (uint8_t) (tap_term / 2);
+    }
+
+    if (learned.tap_term == term->tap_term && learned.release_percent == term->release_percent) return;
+    *term = learned;
+    SMTD_DEBUG("adaptive terms of @%d.%d: tap %dms, release %d%%", sample->key.row, sample->key.col,
+               learned.tap_term * 2, learned.release_percent);
+
+    if (smtd_adaptive_save_token == INVALID_DEFERRED_TOKEN) {
+        smtd_adaptive_save_token = defer_exec(SMTD_ADAPTIVE_SAVE_DELAY_MS, smtd_adaptive_save_tick, NULL);
+    }
+}
+
+// The next key press settles the pending sample: typing on confirms the
+// decision, a Backspace right after it means it was wrong
+static void smtd_adaptive_press(uint16_t pressed_keycode) {
+    smtd_adaptive_sample *sample = &smtd_adaptive_pending;
+    if ((sample->kind == SMTD_SAMPLE_TAP || sample->kind == SMTD_SAMPLE_HOLD) && pressed_keycode != KC_BSPC &&
+        !smtd_time_reached(smtd_now(), (smtd_time_t) (sample->taken_at + SMTD_ADAPTIVE_CONFIRM_MS))) {
+        smtd_adaptive_learn(sample);
+    }
+    // a lone hold isn't lone anymore either
+    sample->kind = SMTD_SAMPLE_NONE;
+}
+
+// Only a decision that is still open is learned from: plain keys and macros
+// that settle on the touch are determined before their release
+static bool smtd_adaptive_learns(smtd_state *state) {
+    return smtd_state_managed(state) && state->resolution == SMTD_RESOLUTION_UNCERTAIN;
+}
+
+// The key was tapped on its own: the tap term has to stay above the press duration
+static void smtd_adaptive_sample_tap(smtd_state *state) {
+    if (!smtd_adaptive_learns(state)) return;
+    smtd_adaptive_pending = (smtd_adaptive_sample) {
+        .kind = SMTD_SAMPLE_TAP,
+        .key = state->pressed_keyposition,
+        .value = (smtd_time_t) (smtd_now() - state->pressed_time),
+        .tap_term = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP),
+        .taken_at = smtd_now(),
+    };
+}
+
+// The key became a hold by its tap term with no other key around. If it comes
+// up before its configured tap term with no key pressed meanwhile, it was meant
+// as a tap, and the learned term is too tight.
+static void smtd_adaptive_sample_lone_hold(smtd_state *state) {
+    if (!smtd_adaptive_learns(state) || smtd_next(state) != NULL) return;
+    smtd_adaptive_pending = (smtd_adaptive_sample) {
+        .kind = SMTD_SAMPLE_LONE_HOLD,
+        .key = state->pressed_keyposition,
+        .tap_term = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP),
+        .taken_at = smtd_now(),
+    };
+}
+
+static void smtd_adaptive_lone_hold_released(smtd_state *state) {
+    smtd_adaptive_sample *sample = &smtd_adaptive_pending;
+    if (sample->kind != SMTD_SAMPLE_LONE_HOLD ||
+        sample->key.row != state->pressed_keyposition.row ||
+        sample->key.col != state->pressed_keyposition.col) {
+        return;
+    }
+
+    sample->kind = SMTD_SAMPLE_NONE;
+    smtd_time_t duration = (smtd_time_t) (smtd_now() - state->pressed_time);
+    if (duration >= sample->tap_term) return;
+
+    sample->kind = SMTD_SAMPLE_TAP;
+    sample->value = duration;
+    smtd_adaptive_learn(sample);
+    sample->kind = SMTD_SAMPLE_NONE;
+}
+
+// ↓key ↓next ↑key ↑next resolved as a hold: the release gap relative to the
+// shorter press pause has to stay under the release percent
+static void smtd_adaptive_sample_hold(smtd_state *state) {
+#if SMTD_GLOBAL_RELEASE_PERCENT > 0
+    smtd_state *next = smtd_next(state);
+    if (!smtd_adaptive_learns(state) || next == NULL) return;
+
+    uint32_t min_pause = smtd_min_pause(state, next);
+    smtd_time_diff_t gap = (smtd_time_diff_t) (smtd_now() - state->released_time);
+    if (min_pause == 0 || gap < 0) return;
+
+    uint32_t ratio = (uint32_t) gap * 100 / min_pause;
+    smtd_adaptive_pending = (smtd_adaptive_sample) {
+        .kind = SMTD_SAMPLE_HOLD,
+        .key = state->pressed_keyposition,
+        .value = ratio > UINT8_MAX ? UINT8_MAX : (uint16_t) ratio,
+        .tap_term = get_smtd_timeout_or_default(state, SMTD_TIMEOUT_TAP),
+        .taken_at = smtd_now(),
+    };
+#endif
+}
+
+void smtd_adaptive_reset(void) {
+    memset(smtd_adaptive_terms, 0, sizeof(smtd_adaptive_terms));
+    smtd_adaptive_loaded = true;
+    smtd_adaptive_pending.kind = SMTD_SAMPLE_NONE;
+    if (smtd_adaptive_save_token != INVALID_DEFERRED_TOKEN) {
+        cancel_deferred_exec(smtd_adaptive_save_token);
+        smtd_adaptive_save_token = INVALID_DEFERRED_TOKEN;
+    }
+    smtd_adaptive_save(smtd_adaptive_terms, sizeof(smtd_adaptive_terms));
+}
+
+#endif
+
+/* ************************************* *
+ *             SPLIT LATENCY             *
+ * ************************************* */
+
+#if SMTD_SPLIT_LATENCY_MS > 0
+
+// Default: the half running sm_td is connected to USB, and the other half's
+// events come SMTD_SPLIT_LATENCY_MS late. Left-hand rows are the first half of
+// the matrix, like QMK's split rows.
+__attribute__((weak)) uint8_t smtd_split_latency(keypos_t key) {
+#ifdef SPLIT_KEYBOARD
+    bool left_row = key.row < MATRIX_ROWS / 2;
+    return left_row == is_keyboard_left() ? 0 : SMTD_SPLIT_LATENCY_MS;
+#else
+    return 0;
+#endif
+}
+
+#endif
+
 /* ************************************* *
  *             CHORDAL HOLD              *
  * ************************************* */
@@ -1128,8 +2838,7 @@ static bool smtd_chordal_same_hand(keypos_t a, keypos_t b) {
 static bool smtd_chordal_all_same_hand(keypos_t current_pos) {
     if (smtd_chordal_handedness(current_pos) == '*') return false;
 
-    for (uint8_t i = 0; i < smtd_active_states_size; i++) {
-        smtd_state *other = smtd_active_states[i];
+    for (smtd_state *other = smtd_active_head; other != NULL; other = smtd_next(other)) {
         if (other->stage == SMTD_STAGE_NONE) continue;
         if (other->stage == SMTD_STAGE_SEQUENCE) continue;
         if (other->pressed_keyposition.row == current_pos.row &&
@@ -1143,6 +2852,75 @@ static bool smtd_chordal_all_same_hand(keypos_t current_pos) {
 
 #endif
 
+/* ************************************* *
+ *          UNMANAGED KEY BYPASS         *
+ * ************************************* */
+
+#if SMTD_BYPASS_UNMANAGED
+__attribute__((weak)) bool smtd_is_managed_key(keypos_t key, uint16_t keycode) {
+#if SMTD_ENABLE_QMK_TAPHOLD && defined(IS_QK_MOD_TAP) && defined(IS_QK_LAYER_TAP)
+    if (IS_QK_MOD_TAP(keycode) || IS_QK_LAYER_TAP(keycode)) return true;
+#endif
+    if (key.row >= MATRIX_ROWS || key.col >= MATRIX_COLS) return true;
+    return pgm_read_byte(&smtd_managed_layout[key.row][key.col]) != 0;
+}
+#endif
+
+#if SMTD_UNMANAGED_KEYS
+
+static bool smtd_key_unmanaged(keypos_t key, uint16_t keycode) {
+#if SMTD_LEARN_UNHANDLED
+    if (smtd_learned_unhandled(keycode)) return true;
+#endif
+#if SMTD_BYPASS_UNMANAGED
+    return !smtd_is_managed_key(key, keycode);
+#else
+    return false;
+#endif
+}
+
+static bool smtd_position_has_state(keypos_t key) {
+    if (smtd_position_indexed(key)) {
+        return smtd_position_owner(key) != NULL;
+    }
+
+    for (smtd_state *state = smtd_active_head; state != NULL; state = smtd_next(state)) {
+        if (state->pressed_keyposition.row == key.row && state->pressed_keyposition.col == key.col) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// An unmanaged press only has to wait while an earlier sm_td key is pending,
+// since that key's decision depends on what is pressed after it. A press with
+// nothing active passes right away; otherwise it is first applied to the active
+// states and passes if they have settled (see smtd_unmanaged_settled). A release is
+// only processed by sm_td when its press created a state; any other release
+// goes to QMK, so a key can't get stuck even if it stopped being unmanaged
+// while it was held.
+static bool smtd_unmanaged_pass_through(uint16_t pressed_keycode, keyrecord_t *record) {
+    if (!record->event.pressed) {
+        return !smtd_position_has_state(record->event.key);
+    }
+
+    return smtd_active_head == NULL && smtd_key_unmanaged(record->event.key, pressed_keycode);
+}
+
+// Whether no active state depends on the keys pressed from now on: held keys
+// only wait for their own release, and earlier unmanaged keys act the same way
+// whether or not a following key is a state
+static bool smtd_unmanaged_settled(void) {
+    for (smtd_state *state = smtd_active_head; state != NULL; state = smtd_next(state)) {
+        if (state->stage == SMTD_STAGE_HOLD) continue;
+        if (state->stage == SMTD_STAGE_TOUCH && state->unmanaged) continue;
+        return false;
+    }
+    return true;
+}
+
+#endif
+
 /* ************************************* *
  *       TEST FRAMEWORK ACCESSORS        *
  * ************************************* */
@@ -1157,7 +2935,11 @@ void smtd_set_bypass(bool bypass) {
     smtd_bypass = bypass;
     if (!bypass) {
         // Reset active states when bypass is disabled (used by test framework)
+        memset(smtd_position_index, 0, sizeof(smtd_position_index));
+        smtd_active_head = NULL;
+        smtd_active_tail = NULL;
         smtd_active_states_size = 0;
+        smtd_undetermined_head = NULL;
     }
 }
 
@@ -1169,8 +2951,8 @@ smtd_state* smtd_get_state_pool(void) {
     return smtd_states_pool;
 }
 
-smtd_state** smtd_get_active_states(void) {
-    return smtd_active_states;
+smtd_state* smtd_get_active_states(void) {
+    return smtd_active_head;
 }
 
 #endif
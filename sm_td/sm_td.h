@@ -26,9 +26,14 @@
 #ifndef SMTD_UNIT_TEST
 #include QMK_KEYBOARD_H
 #include "deferred_exec.h"
+#ifdef VIA_ENABLE
+#include "via.h"
 #endif
+#endif
+
+#include <string.h>
 
-#ifdef SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS
+#if defined(SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS) && !defined(SMTD_UNIT_TEST)
 #include "timer.h"
 #endif
 
@@ -51,13 +56,6 @@
 #define SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS 0
 #endif
 
-#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
-#define SMTD_SIMULTANEOUS_PRESSES_DELAY                                        \
-  wait_ms(SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS);
-#else
-#define SMTD_SIMULTANEOUS_PRESSES_DELAY
-#endif
-
 #ifndef SMTD_GLOBAL_TAP_TERM
 #define SMTD_GLOBAL_TAP_TERM TAPPING_TERM
 #endif
@@ -98,10 +96,45 @@
 #define SMTD_GLOBAL_RELEASE_PERCENT 30
 #endif
 
+// Rolling typing-rhythm model for the dynamic release term (opt-in). When 1,
+// sm_td keeps exponentially weighted averages of the recent press intervals
+// (p1) and roll overlaps (p2) of all keys, and p1 and p2 of the pair being
+// decided are moved halfway to them, so one odd pair moves the window less.
+// Only worth it with a wider SMTD_GLOBAL_RELEASE_PERCENT (e.g. 60): at the
+// default 30 it does slightly worse than the per-pair formula.
+#ifndef SMTD_RHYTHM_MODEL
+#define SMTD_RHYTHM_MODEL 0
+#endif
+
+// Weight of a new sample in the averages as a power of two: 3 -> 1/8
+#ifndef SMTD_RHYTHM_SHIFT
+#define SMTD_RHYTHM_SHIFT 3
+#endif
+
+// Longer pauses are not typing and don't update the averages
+#ifndef SMTD_RHYTHM_MAX_GAP_MS
+#define SMTD_RHYTHM_MAX_GAP_MS 500
+#endif
+
+// Flow taps: a tap-hold key pressed within this many ms after the previous tap
+// was sent is resolved as a tap right on the press, without waiting for its
+// release or a following key. Holds end the streak, so a hold after a pause is
+// still a hold. 0 disables flow taps; per key via SMTD_TIMEOUT_FLOW_TAP.
+#ifndef SMTD_GLOBAL_FLOW_TAP_TERM
+#define SMTD_GLOBAL_FLOW_TAP_TERM 0
+#endif
+
 #ifndef SMTD_GLOBAL_AGGREGATE_TAPS
 #define SMTD_GLOBAL_AGGREGATE_TAPS false
 #endif
 
+// The longest tap sequence a key has a meaning for, 0 for no limit. The tap that
+// reaches it ends the sequence at once instead of after SMTD_TIMEOUT_SEQUENCE.
+// Can be overridden per key via get_smtd_max_tap_count.
+#ifndef SMTD_GLOBAL_MAX_TAP_COUNT
+#define SMTD_GLOBAL_MAX_TAP_COUNT 0
+#endif
+
 // When enabled, sm_td sends resolved tap keys through the full QMK pipeline
 // (process_record) instead of raw tap_code16/register_code16 calls, so QMK
 // features like Caps Word, Auto Shift or Key Overrides can see them.
@@ -113,6 +146,35 @@
 #define SMTD_GLOBAL_PIPELINE_TAPS true
 #endif
 
+// When enabled, a key sends its tap right on the press, before sm_td knows
+// whether it is a tap or a hold. If it turns out to be a hold, the tap is taken
+// back with SMTD_SPECULATIVE_CORRECTION before the hold action runs. Meant for
+// SMTD_MT-like keys whose touch action does nothing; taps are never aggregated.
+// Can be overridden per key via SMTD_FEATURE_SPECULATIVE_TAPS in smtd_feature_enabled.
+#ifndef SMTD_GLOBAL_SPECULATIVE_TAPS
+#define SMTD_GLOBAL_SPECULATIVE_TAPS false
+#endif
+
+// The key tapped to take back a speculative tap that turned out to be a hold
+#ifndef SMTD_SPECULATIVE_CORRECTION
+#define SMTD_SPECULATIVE_CORRECTION KC_BSPC
+#endif
+
+// When enabled, a key is held as soon as any other key is pressed while it is
+// undecided, like QMK's HOLD_ON_OTHER_KEY_PRESS. Meant for thumb layer keys.
+// Can be overridden per key via SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS in smtd_feature_enabled.
+#ifndef SMTD_GLOBAL_HOLD_ON_OTHER_KEY_PRESS
+#define SMTD_GLOBAL_HOLD_ON_OTHER_KEY_PRESS false
+#endif
+
+// When enabled, a key pressed again within its sequence term is held right on
+// the press, so the hold action of the repeated tap (e.g. SMTD_MT registering
+// its tap key once tap_count reaches the threshold) starts OS auto-repeat at once.
+// Can be overridden per key via SMTD_FEATURE_QUICK_TAP in smtd_feature_enabled.
+#ifndef SMTD_GLOBAL_QUICK_TAP
+#define SMTD_GLOBAL_QUICK_TAP false
+#endif
+
 // Enable automatic handling for standard QMK MT() / LT() keycodes.
 // Set to 1 in your config to use MT()/LT() in keymaps without SMTD_MT/SMTD_LT.
 #ifndef SMTD_ENABLE_QMK_TAPHOLD
@@ -131,6 +193,135 @@
 #define SMTD_CHORDAL_HOLD 0
 #endif
 
+// Permissive chordal hold, needs SMTD_CHORDAL_HOLD. When 1, the press of a key
+// that is not on the same hand settles a pending tap-hold as HOLD right away,
+// instead of waiting for that key's release or the tap term. Shortcuts fire on
+// the press, but a quick roll across hands is held as well.
+#ifndef SMTD_CHORDAL_PERMISSIVE
+#define SMTD_CHORDAL_PERMISSIVE 0
+#endif
+
+// Let keys that sm_td does not manage skip the engine. When 1, a press of a key
+// marked as unmanaged (see smtd_is_managed_key) goes straight to QMK while no
+// sm_td key is pending; while one is pending it is queued as a lightweight state
+// that never reaches on_smtd_action or the per-key hooks.
+#ifndef SMTD_BYPASS_UNMANAGED
+#define SMTD_BYPASS_UNMANAGED 0
+#endif
+
+// Learn at runtime which keycodes on_smtd_action leaves unhandled. When 1, a basic
+// keycode (KC_A .. KC_RGUI) whose first touch came back SMTD_RESOLUTION_UNHANDLED
+// is remembered in a 32-byte bitset, and its later presses take the same path as
+// unmanaged keys (see SMTD_BYPASS_UNMANAGED). For keymaps edited at runtime.
+#ifndef SMTD_LEARN_UNHANDLED
+#define SMTD_LEARN_UNHANDLED 0
+#endif
+
+#define SMTD_UNMANAGED_KEYS (SMTD_BYPASS_UNMANAGED || SMTD_LEARN_UNHANDLED)
+
+// Let sm_td define QMK's via_command_kb and call smtd_keymap_changed whenever
+// VIA / Vial writes the dynamic keymap. Off by default, since a keyboard that
+// defines via_command_kb itself would no longer link: call smtd_via_command from
+// your via_command_kb instead, or set to 1 if nothing else defines it.
+#ifndef SMTD_VIA_KEYMAP_HOOK
+#define SMTD_VIA_KEYMAP_HOOK 0
+#endif
+
+// Stream long macro output (snippets, code templates) from on_smtd_action. When 1,
+// smtd_stream_string / smtd_stream_tap queue their output, and a deferred exec
+// sends one character or keycode every SMTD_STREAM_INTERVAL_MS. Key events that
+// arrive meanwhile wait behind the stream (up to SMTD_STREAM_HELD_SIZE of them).
+#ifndef SMTD_MACRO_STREAM
+#define SMTD_MACRO_STREAM 0
+#endif
+
+#ifndef SMTD_STREAM_SIZE
+#define SMTD_STREAM_SIZE 16
+#endif
+
+#ifndef SMTD_STREAM_HELD_SIZE
+#define SMTD_STREAM_HELD_SIZE 8
+#endif
+
+// Characters of streamed strings waiting to be sent, copied from the caller (at most 255)
+#ifndef SMTD_STREAM_CHARS_SIZE
+#define SMTD_STREAM_CHARS_SIZE 64
+#endif
+
+#ifndef SMTD_STREAM_INTERVAL_MS
+#define SMTD_STREAM_INTERVAL_MS 1
+#endif
+
+// The queue behind the macro stream also spaces sm_td's own outputs when
+// SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS is set, instead of waiting for them
+#define SMTD_OUTPUT_QUEUE (SMTD_MACRO_STREAM || SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0)
+
+// Split keyboards: QMK stamps the events of the half that isn't connected to USB
+// when they arrive over the split transport, a few milliseconds after the press.
+// When > 0, those events are moved back by smtd_split_latency() (at most this
+// many ms), and timeouts wait as long for them before they fire.
+#ifndef SMTD_SPLIT_LATENCY_MS
+#define SMTD_SPLIT_LATENCY_MS 0
+#endif
+
+// Learn per-key tap terms and release windows from the typing (opt-in). When 1,
+// sm_td watches decisions that turned out right (a tap followed by more typing,
+// a hold with a key released under it) and moves the tap term and the release
+// percent of each key toward the tightest value that still fits them. The
+// configured values stay the upper bound. The learned table takes 2 bytes per
+// matrix position, in RAM and in EEPROM (see smtd_adaptive_load / save).
+#ifndef SMTD_ADAPTIVE_TERMS
+#define SMTD_ADAPTIVE_TERMS 0
+#endif
+
+// How much longer than the observed taps the learned tap term stays
+#ifndef SMTD_ADAPTIVE_TAP_MARGIN_MS
+#define SMTD_ADAPTIVE_TAP_MARGIN_MS 50
+#endif
+
+// How many percent points above the observed hold ratios the learned release percent stays
+#ifndef SMTD_ADAPTIVE_RELEASE_MARGIN
+#define SMTD_ADAPTIVE_RELEASE_MARGIN 10
+#endif
+
+// The learned tap term never gets shorter than this
+#ifndef SMTD_ADAPTIVE_MIN_TAP_TERM
+#define SMTD_ADAPTIVE_MIN_TAP_TERM (SMTD_GLOBAL_TAP_TERM / 2)
+#endif
+
+// A learned term moves 1/SMTD_ADAPTIVE_RATE of the way to a tighter value per
+// sample; a sample that needs a wider value widens it right away
+#ifndef SMTD_ADAPTIVE_RATE
+#define SMTD_ADAPTIVE_RATE 8
+#endif
+
+// A decision counts as right when the next key press comes within this time
+// and isn't a Backspace
+#ifndef SMTD_ADAPTIVE_CONFIRM_MS
+#define SMTD_ADAPTIVE_CONFIRM_MS 1000
+#endif
+
+// Changes are written to EEPROM this long after the first unsaved one
+#ifndef SMTD_ADAPTIVE_SAVE_DELAY_MS
+#define SMTD_ADAPTIVE_SAVE_DELAY_MS 60000
+#endif
+
+// Offset of the learned table in QMK's EEPROM user datablock
+#ifndef SMTD_ADAPTIVE_EEPROM_OFFSET
+#define SMTD_ADAPTIVE_EEPROM_OFFSET 0
+#endif
+
+// Compact state layout for RAM-constrained (AVR) boards. When 1, every slot of
+// the state pool packs its stage/resolution/action fields into bitfields, keeps
+// times as 16-bit values of a wrapping millisecond clock and links the active
+// list with uint8_t pool indices instead of pointers. It also keeps no per-state
+// snapshot of the per-key hooks and no cached keymap keycode: those are
+// evaluated again on every read. Timeouts and the pauses used by the dynamic
+// release term must then stay below 32 seconds.
+#ifndef SMTD_COMPACT_STATE
+#define SMTD_COMPACT_STATE 0
+#endif
+
 #include <stdint.h>
 
 
@@ -164,15 +355,45 @@ typedef enum {
     SMTD_TIMEOUT_TAP,
     SMTD_TIMEOUT_SEQUENCE,
     SMTD_TIMEOUT_RELEASE,
+    SMTD_TIMEOUT_FLOW_TAP,
 } smtd_timeout;
 
+#define SMTD_TIMEOUTS_SIZE 4
+
 typedef enum {
     SMTD_FEATURE_AGGREGATE_TAPS,
     SMTD_FEATURE_PIPELINE_TAPS,
+    SMTD_FEATURE_SPECULATIVE_TAPS,
+    SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS,
+    SMTD_FEATURE_QUICK_TAP,
 } smtd_feature;
 
+#define SMTD_FEATURES_SIZE 5
 
-typedef struct {
+
+#if SMTD_COMPACT_STATE
+/** Low 16 bits of the millisecond clock; compared with wrap-around arithmetic */
+typedef uint16_t smtd_time_t;
+typedef int16_t smtd_time_diff_t;
+
+/** A state in the active list as its pool index + 1, 0 when there is none */
+typedef uint8_t smtd_state_link;
+#define SMTD_NO_LINK 0
+
+#define SMTD_BITFIELD(bits) : bits
+#else
+typedef uint32_t smtd_time_t;
+typedef int32_t smtd_time_diff_t;
+
+typedef struct smtd_state *smtd_state_link;
+#define SMTD_NO_LINK NULL
+
+#define SMTD_BITFIELD(bits)
+#endif
+
+#define SMTD_NO_LAYER 0xFF
+
+typedef struct smtd_state {
     /** The position of a key that QMK thinks was pressed */
     keypos_t pressed_keyposition;
 
@@ -182,80 +403,279 @@ typedef struct {
     /** The keycode that should be actually pressed (asked outside or determined by the tap action) */
     uint16_t desired_keycode;
 
+#if !SMTD_COMPACT_STATE
+    /** The keymap keycode at the pressed position, valid while position_layer is the highest layer */
+    uint16_t position_keycode;
+
+    /** The layer position_keycode was resolved under, SMTD_NO_LAYER if not resolved yet */
+    uint8_t position_layer;
+
+    /** get_smtd_timeout results for desired_keycode, indexed by smtd_timeout (capped at 65535ms) */
+    uint16_t timeouts[SMTD_TIMEOUTS_SIZE];
+
+    /** smtd_feature_enabled results for desired_keycode, one bit per smtd_feature */
+    uint8_t features;
+
+    /** get_smtd_max_tap_count result for desired_keycode, 0 for no limit */
+    uint8_t max_tap_count;
+#endif
+
     /** The length of the sequence of same key taps */
     uint8_t tap_count;
 
     /** The time when the key was pressed */
-    uint32_t pressed_time;
+    smtd_time_t pressed_time;
 
     /** The time when the key was released */
-    uint32_t released_time;
+    smtd_time_t released_time;
 
     /** The decision window for the touch-release stage, computed on entering it */
-    uint32_t release_term;
+    smtd_time_t release_term;
 
-    /** The timeout of current stage */
-    deferred_token timeout;
+    /** The time when the timeout of current stage fires */
+    smtd_time_t timeout_at;
+
+    /** Whether the timeout of current stage is scheduled */
+    bool timeout_pending SMTD_BITFIELD(1);
+
+    /** Whether another key was pressed while a flow tapped key is held, so its release ends the sequence */
+    bool flow_interrupted SMTD_BITFIELD(1);
 
     /** The current stage of the state */
-    smtd_stage stage;
+    smtd_stage stage SMTD_BITFIELD(3);
 
     /** The level of certainty of the state */
-    smtd_resolution resolution;
+    smtd_resolution resolution SMTD_BITFIELD(2);
 
     /** The action that already performed */
-    int8_t action_performed;
+    int8_t action_performed SMTD_BITFIELD(3);
 
     /** The action that can be performed */
-    int8_t action_required;
-
-    /** The index of the state in the active states array */
-    uint8_t idx;
+    int8_t action_required SMTD_BITFIELD(3);
 
     /** Whether the last SMTD_REGISTER_16 was emulated through the full QMK pipeline */
-    bool emulated_register;
+    bool emulated_register SMTD_BITFIELD(1);
+
+    /** Whether the tap was sent on the touch and is not confirmed yet (SMTD_FEATURE_SPECULATIVE_TAPS) */
+    bool speculative SMTD_BITFIELD(1);
+
+#if SMTD_UNMANAGED_KEYS
+    /** Whether the key is not managed by sm_td and is only queued behind pending states */
+    bool unmanaged SMTD_BITFIELD(1);
+#endif
+
+    /** The previous (earlier pressed) state in the active list */
+    smtd_state_link prev;
+
+    /** The next (later pressed) state in the active list */
+    smtd_state_link next;
+
+    /** Press order of the state among active states, larger is later */
+    uint8_t seq;
 } smtd_state;
 
 
+#if SMTD_COMPACT_STATE
+#define SMTD_EMPTY_SNAPSHOT
+#else
+#define SMTD_EMPTY_SNAPSHOT                         \
+        .position_keycode = 0,                      \
+        .position_layer = SMTD_NO_LAYER,            \
+        .timeouts = {0},                            \
+        .features = 0,                              \
+        .max_tap_count = 0,
+#endif
+
 #define EMPTY_STATE {                               \
         .pressed_keyposition = MAKE_KEYPOS(0, 0),   \
         .pressed_keycode = 0,                       \
         .desired_keycode = 0,                       \
+        SMTD_EMPTY_SNAPSHOT                         \
         .tap_count = 0,                             \
         .pressed_time = 0,                          \
         .released_time = 0,                         \
         .release_term = 0,                          \
-        .timeout = INVALID_DEFERRED_TOKEN,          \
+        .timeout_at = 0,                            \
+        .timeout_pending = false,                   \
+        .flow_interrupted = false,                  \
         .stage = SMTD_STAGE_NONE,                   \
         .resolution = SMTD_RESOLUTION_UNCERTAIN,    \
         .action_performed = -1,                     \
         .action_required = -1,                      \
-        .idx = 0,                                   \
         .emulated_register = false,                 \
+        .speculative = false,                       \
+        .prev = SMTD_NO_LINK,                       \
+        .next = SMTD_NO_LINK,                       \
+        .seq = 0,                                   \
 }
 
 #ifndef SMTD_POOL_SIZE
 #define SMTD_POOL_SIZE 10
 #endif
 
+#if SMTD_POOL_SIZE > 255
+#error "SMTD_POOL_SIZE must fit into uint8_t slot indices"
+#endif
+
+#if SMTD_OUTPUT_QUEUE
+typedef enum {
+    SMTD_STREAM_STRING,
+    SMTD_STREAM_TAP,
+    SMTD_STREAM_REGISTER,
+    SMTD_STREAM_UNREGISTER,
+    SMTD_STREAM_EMULATE_PRESS,
+    SMTD_STREAM_EMULATE_RELEASE,
+    SMTD_STREAM_REPORT,
+} smtd_stream_kind;
+
+typedef struct {
+    smtd_stream_kind kind;
+
+    /** How many of the copied characters are left to send, for SMTD_STREAM_STRING */
+    uint8_t length;
+
+    /** The keycode to send, for SMTD_STREAM_TAP / REGISTER / UNREGISTER */
+    uint16_t keycode;
+
+    /** The position to replay through process_record, for SMTD_STREAM_EMULATE_* */
+    keypos_t key;
+
+    /** Whether the item is sent with the mods and layers below instead of the current ones */
+    bool queued_state;
+
+    /** Mods, weak mods and layers at the time sm_td queued its own output */
+    uint8_t mods;
+    uint8_t weak_mods;
+    layer_state_t layers;
+} smtd_stream_item;
+
+typedef struct {
+    uint16_t pressed_keycode;
+    uint16_t desired_keycode;
+    keyrecord_t record;
+} smtd_held_event;
+#endif
+
+#if SMTD_ADAPTIVE_TERMS
+/** Learned terms of a matrix position. 0 means nothing learned, the configured value applies */
+typedef struct {
+    /** Tap term in 2ms units */
+    uint8_t tap_term;
+
+    /** SMTD_GLOBAL_RELEASE_PERCENT for the key */
+    uint8_t release_percent;
+} smtd_adaptive_term;
+
+typedef enum {
+    SMTD_SAMPLE_NONE,
+    SMTD_SAMPLE_TAP,
+    SMTD_SAMPLE_HOLD,
+    SMTD_SAMPLE_LONE_HOLD,
+} smtd_sample_kind;
+
+/** A decision waiting for the next key press to confirm it */
+typedef struct {
+    smtd_sample_kind kind;
+    keypos_t key;
+
+    /** Press duration for SMTD_SAMPLE_TAP, release ratio in percent for SMTD_SAMPLE_HOLD */
+    uint16_t value;
+
+    /** The configured tap term of the key */
+    uint16_t tap_term;
+
+    smtd_time_t taken_at;
+} smtd_adaptive_sample;
+#endif
+
+#if SMTD_RHYTHM_MODEL
+/** Recent typing rhythm (SMTD_RHYTHM_MODEL). Averages are in 1/8 ms, 0 means no sample yet */
+typedef struct {
+    /** Average pause between two presses */
+    uint16_t interval;
+
+    /** Average time a key was still held after a later key was pressed */
+    uint16_t overlap;
+
+    /** The time and the position of the last press, and whether it is still down */
+    smtd_time_t last_press;
+    keypos_t last_key;
+    bool last_down;
+    bool typing;
+} smtd_rhythm;
+#endif
+
+/** How often speculative taps were sent and taken back (SMTD_FEATURE_SPECULATIVE_TAPS) */
+typedef struct {
+    uint16_t taps;
+    uint16_t rollbacks;
+} smtd_speculative_stats;
+
 /* ************************************* *
  *           PUBLIC FUNCTIONS            *
  * ************************************* */
 
 bool process_smtd(uint16_t keycode, keyrecord_t *record);
 
-/* Clears all sm_td runtime state: the state pool, the active-state list, any
- * pending timeout deferred-execs, and the executing/bypass flags. Intended for
+/* Clears all sm_td runtime state: the state pool, the active-state list, the
+ * pending timeout deferred-exec, and the executing/bypass flags. Intended for
  * test harnesses that reuse one process across scenarios (the QMK test fixture
  * resets QMK state but not sm_td's). Harmless but normally unused in firmware. */
 void smtd_reset(void);
 
+/* Drops the keycodes active states have cached for their pressed positions,
+ * and the keycodes learned with SMTD_LEARN_UNHANDLED. sm_td resolves a state's
+ * keycode once per highest layer, so layer changes need no call. VIA / Vial writes
+ * call it through smtd_via_command (see SMTD_VIA_KEYMAP_HOOK); call it yourself
+ * after writing the keymap at runtime in any other way (e.g.
+ * dynamic_keymap_set_keycode). */
+void smtd_keymap_changed(void);
+
+#ifdef VIA_ENABLE
+/* Calls smtd_keymap_changed if the VIA command in data writes the keymap. Call it
+ * at the start of via_command_kb, unless SMTD_VIA_KEYMAP_HOOK defines that. */
+void smtd_via_command(uint8_t *data, uint8_t length);
+#endif
+
+/* True while sm_td replays a deferred key through process_record(). Such a key
+ * has already passed every hook in front of sm_td once, on its physical press or
+ * release, so work done there (e.g. in process_record_kb, or in
+ * process_record_user before process_smtd) can skip the replayed record.
+ * Hooks behind sm_td only ever see the replay and must not skip it. */
+bool smtd_is_emulating(void);
+
+#if SMTD_MACRO_STREAM
+/* Queue output behind the running stream instead of sending it right away (see
+ * SMTD_MACRO_STREAM). The string is copied, so it may be a stack buffer. Anything
+ * sm_td itself sends while the stream is running is queued behind it too, so the
+ * output keeps its order. Mods and layers changed meanwhile apply to the rest of
+ * the stream. */
+void smtd_stream_string(const char *str);
+
+void smtd_stream_tap(uint16_t keycode);
+
+/* True while streamed output is still waiting to be sent */
+bool smtd_stream_active(void);
+#endif
+
+#if SMTD_ADAPTIVE_TERMS
+/* Forgets the learned terms of every key (see SMTD_ADAPTIVE_TERMS) and writes
+ * the empty table right away, e.g. from a keycode of your own */
+void smtd_adaptive_reset(void);
+#endif
+
+/* Counters of speculative taps since boot, saturating at 65535. A high share of
+ * rollbacks means the mode costs more corrections than it saves latency */
+smtd_speculative_stats smtd_get_speculative_stats(void);
+
 smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count);
 
 __attribute__((weak)) uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout);
 
 __attribute__((weak)) bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature);
 
+__attribute__((weak)) uint8_t get_smtd_max_tap_count(uint16_t keycode);
+
 #if SMTD_CHORDAL_HOLD
 // Per-key handedness used by the chordal-hold rule. Returns 'L' (left), 'R'
 // (right) or '*' (neutral, e.g. thumbs). The default reads the user-supplied
@@ -268,6 +688,35 @@ __attribute__((weak)) char smtd_chordal_handedness(keypos_t key);
 extern const char chordal_hold_layout[MATRIX_ROWS][MATRIX_COLS];
 #endif
 
+#if SMTD_SPLIT_LATENCY_MS > 0
+// How many ms late the key's events arrive over the split transport. The default
+// returns SMTD_SPLIT_LATENCY_MS for the half that isn't running sm_td and 0 for
+// the other one; it is weak so a keymap can return a measured latency instead.
+__attribute__((weak)) uint8_t smtd_split_latency(keypos_t key);
+#endif
+
+#if SMTD_ADAPTIVE_TERMS
+// Read / write the learned table. The default keeps it in QMK's EEPROM user
+// datablock at SMTD_ADAPTIVE_EEPROM_OFFSET (EECONFIG_USER_DATA_SIZE has to fit
+// it), or doesn't persist it without a datablock; weak so a keymap can keep it
+// elsewhere. A zeroed table means nothing was learned yet.
+__attribute__((weak)) void smtd_adaptive_load(void *data, uint16_t size);
+__attribute__((weak)) void smtd_adaptive_save(const void *data, uint16_t size);
+#endif
+
+#if SMTD_BYPASS_UNMANAGED
+// Whether a key press has to go through sm_td. The keycode is the one QMK
+// resolved for the press. The default treats MT() / LT() keycodes as managed
+// when SMTD_ENABLE_QMK_TAPHOLD is on, and otherwise reads the user-supplied
+// smtd_managed_layout from PROGMEM; it is weak so a keymap can decide by
+// keycode instead of position.
+__attribute__((weak)) bool smtd_is_managed_key(keypos_t key, uint16_t keycode);
+
+// Layout marking each matrix position that holds an sm_td key on any layer with
+// a non-zero value. Required when the default smtd_is_managed_key() is used.
+extern const uint8_t smtd_managed_layout[MATRIX_ROWS][MATRIX_COLS];
+#endif
+
 extern const uint16_t keymaps[][MATRIX_ROWS][MATRIX_COLS];
 
 
@@ -277,7 +726,7 @@ extern const uint16_t keymaps[][MATRIX_ROWS][MATRIX_COLS];
 
 bool smtd_process_desired(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
-void smtd_apply_to_stack(uint8_t starting_idx, uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
+void smtd_apply_to_stack(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
 void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
@@ -373,8 +822,8 @@ uint32_t last_key_timer = 0;
     SMTD_DEBUG("## ## ## ## ## ## ## ## ## ## ## ## ## ## ## ## ## ## ## ## "  \
                "## ## ## ## ## ## ## ## ## ## ## ## ##\n");                    \
   };                                                                           \
-  for (int asdf = 0; asdf < smtd_active_states_size; asdf++) {                 \
-    SMTD_DEBUG("## %s", smtd_state_to_str(smtd_active_states[asdf]));          \
+  for (smtd_state *asdf = smtd_active_head; asdf; asdf = smtd_next(asdf)) {   \
+    SMTD_DEBUG("## %s", smtd_state_to_str(asdf));                              \
   }
 #endif
 
@@ -438,6 +887,8 @@ uint32_t timeout_touch_release(uint32_t trigger_time, void *cb_arg);
 
 uint32_t timeout_hold_release(uint32_t trigger_time, void *cb_arg);
 
+uint32_t smtd_timer_tick(uint32_t trigger_time, void *cb_arg);
+
 
 /* ************************************* *
  *             STATE PROCESSING          *
@@ -447,8 +898,7 @@ bool process_smtd(uint16_t pressed_keycode, keyrecord_t *record);
 
 bool smtd_process_desired(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
-void
-smtd_apply_to_stack(uint8_t starting_idx, uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
+void smtd_apply_to_stack(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
 void smtd_create_state(uint16_t pressed_keycode, keyrecord_t *record, uint16_t desired_keycode);
 
@@ -480,6 +930,8 @@ uint32_t smtd_compute_release_term(smtd_state *state);
 
 uint16_t smtd_current_keycode(keypos_t *key);
 
+uint16_t smtd_position_keycode(smtd_state *state);
+
 bool smtd_feature_enabled_or_default(smtd_state *state, smtd_feature feature);
 
 bool smtd_feature_enabled_default(uint16_t keycode, smtd_feature feature);
@@ -489,6 +941,12 @@ bool smtd_feature_enabled_default(uint16_t keycode, smtd_feature feature);
  *         CUSTOMIZATION MACROS          *
  * ************************************* */
 
+/* Sends the keyboard report, or, while sm_td resolves a cascade of keys, marks it
+ * to be sent once: at the end of the cascade or right before the next key sm_td
+ * sends. Use it with add_mods / del_mods instead of register_mods / unregister_mods
+ * (which report on their own) to coalesce mod changes of several keys. */
+void smtd_send_report(void);
+
 void smtd_tap_code16(bool use_cl, uint16_t key);
 
 void smtd_register_code16(bool use_cl, uint16_t key);
@@ -527,6 +985,10 @@ void smtd_unregister_code16(bool use_cl, uint16_t key);
 #define SMTD_LIMIT(limit, if_under_limit, otherwise) \
     if (tap_count < limit) { if_under_limit; } else { otherwise; }
 
+// For get_smtd_max_tap_count: a key that only tells `count` taps apart
+#define SMTD_MAX_TAPS(macro_key, count) \
+    case macro_key: return count;
+
 #define SMTD_DANCE(macro_key, touch_action, tap_action, hold_action, release_action)    \
     case macro_key: {                                                                   \
         switch (action) {                                                               \
@@ -550,14 +1012,14 @@ void smtd_unregister_code16(bool use_cl, uint16_t key);
         NOTHING,                                             \
         SMTD_TAP_16(use_cl, tap_key),                        \
         SMTD_LIMIT(threshold,                                \
-            register_mods(MOD_BIT(mod));                     \
-            send_keyboard_report(),                          \
+            add_mods(MOD_BIT(mod));                          \
+            smtd_send_report(),                              \
             SMTD_REGISTER_16(use_cl, tap_key)),              \
         SMTD_LIMIT(threshold,                                \
-            unregister_mods(MOD_BIT(mod));                   \
-            send_keyboard_report(),                          \
+            del_mods(MOD_BIT(mod));                          \
+            smtd_send_report(),                              \
             SMTD_UNREGISTER_16(use_cl, tap_key));            \
-            send_keyboard_report()                           \
+            smtd_send_report()                               \
     )
 
 #define SMTD_MTE(...) OVERLOAD4(__VA_ARGS__, SMTD_MTE4, SMTD_MTE3, SMTD_MTE2)(__VA_ARGS__)
@@ -572,25 +1034,26 @@ void smtd_unregister_code16(bool use_cl, uint16_t key);
 #define SMTD_MBTE5_ON_MKEY(macro_key, tap_key, mods, threshold, use_cl) \
     SMTD_DANCE(macro_key,                                    \
         EXEC(                                                \
-            register_mods(mods);                             \
-            send_keyboard_report();                          \
+            add_mods(mods);                                  \
+            smtd_send_report();                              \
         ),                                                   \
         EXEC(                                                \
-            unregister_mods(mods);                           \
+            del_mods(mods);                                  \
+            smtd_send_report();                              \
             SMTD_TAP_16(use_cl, tap_key);                    \
         ),                                                   \
         SMTD_LIMIT(threshold,                                \
             NOTHING,                                         \
             EXEC(                                            \
-                unregister_mods(mods);                       \
-                send_keyboard_report();                      \
+                del_mods(mods);                              \
+                smtd_send_report();                          \
                 SMTD_REGISTER_16(use_cl, tap_key);           \
             )                                                \
         ),                                                   \
         SMTD_LIMIT(threshold,                                \
             EXEC(                                            \
-                unregister_mods(mods);                       \
-                send_keyboard_report();                      \
+                del_mods(mods);                              \
+                smtd_send_report();                          \
             ),                                               \
             SMTD_UNREGISTER_16(use_cl, tap_key)              \
         )                                                    \
@@ -0,0 +1,124 @@
+/* Host benchmark for the deferred-action cascade.
+ *
+ * N mod-tap keys are pressed together and released in reverse order, so every
+ * state but the first defers its tap behind the first one. Releasing the first
+ * key resolves it and runs the whole cascade. The scenario is repeated and the
+ * average time per scenario, minus the cost of the harness reset, is printed
+ * for 2, 5 and 10 stacked states.
+ *
+ * Build and run with `just bench` (or compile this file with any C11 compiler
+ * from the repository root: cc -O2 -std=c11 -I. tests/benchmarks/cascade.c).
+ */
+#define _POSIX_C_SOURCE 199309L
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 1
+#define MATRIX_COLS 12
+
+#define TAPPING_TERM 200
+
+/* keep the engine's debug tracing and the mocks' output out of the measurement */
+#define TEST_QUIET
+#define SMTD_DEBUG(...)
+#define SMTD_DEBUG_INPUT(...)
+#define SMTD_DEBUG_FULL(...)
+
+#include <time.h>
+
+#include "../unit/sm_td_bindings.c"
+
+#define BENCH_ITERATIONS 200000
+
+enum KEYCODES {
+    KC_0 = 100, KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_10, KC_11,
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [0] = {{ KC_0, KC_1, KC_2, KC_3, KC_4, KC_5, KC_6, KC_7, KC_8, KC_9, KC_10, KC_11 }},
+};
+
+static uint32_t bench_actions = 0;
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    bench_actions++;
+    switch (keycode) {
+        SMTD_MT(KC_1, KC_LSFT)
+        SMTD_MT(KC_2, KC_LSFT)
+        SMTD_MT(KC_3, KC_LSFT)
+        SMTD_MT(KC_4, KC_LSFT)
+        SMTD_MT(KC_5, KC_LSFT)
+        SMTD_MT(KC_6, KC_LSFT)
+        SMTD_MT(KC_7, KC_LSFT)
+        SMTD_MT(KC_8, KC_LSFT)
+        SMTD_MT(KC_9, KC_LSFT)
+        SMTD_MT(KC_10, KC_LSFT)
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    return NULL;
+}
+
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
+
+static void bench_key(uint8_t col, bool pressed) {
+    keyrecord_t record = {.event = MAKE_KEYEVENT(0, col, pressed)};
+    process_smtd(keymaps[0][0][col], &record);
+}
+
+static void bench_scenario(uint8_t stacked) {
+    TEST_reset();
+    for (uint8_t i = 1; i <= stacked; i++) {
+        bench_key(i, true);
+    }
+    for (uint8_t i = stacked; i >= 1; i--) {
+        bench_key(i, false);
+    }
+    TEST_flush_timeouts();
+}
+
+static double bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+/* average ns per run; stacked = 0 measures the harness reset alone */
+static double bench_run(uint8_t stacked) {
+    bench_scenario(stacked); // warm up
+
+    double started = bench_now_ns();
+    for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+        bench_scenario(stacked);
+    }
+    return (bench_now_ns() - started) / BENCH_ITERATIONS;
+}
+
+int main(void) {
+    const uint8_t stacks[] = {2, 5, 10};
+    double harness = bench_run(0);
+
+    printf("%-8s %14s %16s\n", "stacked", "ns/scenario", "actions/scenario");
+    for (uint8_t s = 0; s < sizeof(stacks); s++) {
+        bench_actions = 0;
+        double elapsed = bench_run(stacks[s]) - harness;
+        printf("%-8u %14.1f %16u\n", stacks[s], elapsed, bench_actions / (BENCH_ITERATIONS + 1));
+    }
+    return 0;
+}
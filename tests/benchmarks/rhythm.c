@@ -0,0 +1,262 @@
+/* Replay benchmark for the dynamic release term.
+ *
+ * A simulated typist types through sessions of different speed. Every trial is
+ * a few plain keys typed in the session's rhythm, followed by one ambiguous
+ * `↓mod ↓key ↑mod ↑key` sequence on a mod-tap key:
+ *   roll - meant as two taps: the mod-tap is released while the next key is
+ *          down, and the next key comes up about one typing interval later
+ *   hold - meant as mod+key: the mod is let go a few ms before the key
+ * Press pauses, hold times and overlaps are jittered around the session's
+ * rhythm. Every sequence is replayed through process_smtd and the output is
+ * checked against the intent. For rolls the time from ↑mod until the tap of
+ * the mod-tap is sent is the latency the release window adds.
+ *
+ * `just bench` builds the file with the per-pair formula (SMTD_RHYTHM_MODEL=0)
+ * and with the rhythm model, at the default and at a wider release percent, so
+ * the results can be compared line by line. To build one variant by hand, from
+ * the repository root:
+ * cc -O2 -std=c11 -I. -DSMTD_RHYTHM_MODEL=1 tests/benchmarks/rhythm.c
+ *
+ * bench-variants: -DSMTD_RHYTHM_MODEL=0 | -DSMTD_RHYTHM_MODEL=1 | -DSMTD_RHYTHM_MODEL=0 -DSMTD_GLOBAL_RELEASE_PERCENT=60 | -DSMTD_RHYTHM_MODEL=1 -DSMTD_GLOBAL_RELEASE_PERCENT=60
+ */
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 1
+#define MATRIX_COLS 6
+
+#define TAPPING_TERM 200
+
+/* keep the engine's debug tracing and the mocks' output out of the measurement */
+#define TEST_QUIET
+#define SMTD_DEBUG(...)
+#define SMTD_DEBUG_INPUT(...)
+#define SMTD_DEBUG_FULL(...)
+
+#include "../unit/sm_td_bindings.c"
+
+#define RHYTHM_TRIALS_PER_SESSION 400
+#define RHYTHM_FILLER_KEYS 4
+#define RHYTHM_MAX_EVENTS 16
+
+/* col 1 is the mod-tap, cols 2..5 are plain keys */
+#define RHYTHM_MOD_COL 1
+#define RHYTHM_KEY_COL 5
+
+enum KEYCODES {
+    KC_0 = 100, KC_1, KC_2, KC_3, KC_4, KC_5,
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [0] = {{ KC_0, KC_1, KC_2, KC_3, KC_4, KC_5 }},
+};
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_MT(KC_1, KC_LSFT)
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    return NULL;
+}
+
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
+
+typedef struct {
+    uint32_t time;
+    uint8_t col;
+    bool pressed;
+} rhythm_event;
+
+typedef struct {
+    rhythm_event events[RHYTHM_MAX_EVENTS];
+    uint8_t size;
+    bool hold;
+    /** the time of ↑mod */
+    uint32_t mod_released;
+} rhythm_trial;
+
+typedef struct {
+    uint32_t rolls, roll_misfires;
+    uint32_t holds, hold_misfires;
+    uint64_t latency_sum;
+    uint32_t latency_max;
+} rhythm_result;
+
+static uint32_t rhythm_rng = 0x5eed;
+
+static uint32_t rhythm_random(void) {
+    rhythm_rng = rhythm_rng * 1103515245u + 12345u;
+    return rhythm_rng >> 8;
+}
+
+/* base * [low .. high] percent */
+static uint32_t rhythm_jitter(uint32_t base, uint32_t low, uint32_t high) {
+    return base * (low + rhythm_random() % (high - low + 1)) / 100;
+}
+
+static void rhythm_push(rhythm_trial *trial, uint32_t time, uint8_t col, bool pressed) {
+    if (trial->size < RHYTHM_MAX_EVENTS) {
+        trial->events[trial->size++] = (rhythm_event) {time, col, pressed};
+    }
+}
+
+static void rhythm_sort(rhythm_trial *trial) {
+    for (uint8_t i = 1; i < trial->size; i++) {
+        for (uint8_t j = i; j > 0 && trial->events[j].time < trial->events[j - 1].time; j--) {
+            rhythm_event swap = trial->events[j];
+            trial->events[j] = trial->events[j - 1];
+            trial->events[j - 1] = swap;
+        }
+    }
+}
+
+static void rhythm_build(rhythm_trial *trial, uint32_t interval, bool hold) {
+    *trial = (rhythm_trial) {.hold = hold};
+
+    // plain keys typed in the session's rhythm, each held 80..150ms
+    uint32_t now = 1000;
+    for (uint8_t i = 0; i < RHYTHM_FILLER_KEYS; i++) {
+        uint8_t col = 2 + i % 3;
+        rhythm_push(trial, now, col, true);
+        rhythm_push(trial, now + 80 + rhythm_random() % 71, col, false);
+        now += rhythm_jitter(interval, 60, 140);
+    }
+
+    uint32_t key_pressed, mod_released, key_released;
+    if (hold) {
+        // a quick chord: both keys come up within the tap term, the mod 1..25ms first
+        key_pressed = now + 20 + rhythm_random() % 81;
+        mod_released = key_pressed + 30 + rhythm_random() % 61;
+        key_released = mod_released + 1 + rhythm_random() % 25;
+    } else {
+        // the next key of the roll is pressed while the mod-tap is still down
+        do {
+            key_pressed = now + rhythm_jitter(interval, 40, 140);
+            mod_released = now + 80 + rhythm_random() % 71;
+            key_released = key_pressed + 80 + rhythm_random() % 71;
+        } while (key_pressed + 5 > mod_released || key_released <= mod_released);
+    }
+    rhythm_push(trial, now, RHYTHM_MOD_COL, true);
+    rhythm_push(trial, key_pressed, RHYTHM_KEY_COL, true);
+    rhythm_push(trial, mod_released, RHYTHM_MOD_COL, false);
+    rhythm_push(trial, key_released, RHYTHM_KEY_COL, false);
+    trial->mod_released = mod_released;
+    rhythm_sort(trial);
+}
+
+static bool rhythm_mod_tapped(void) {
+    for (uint8_t i = 0; i < record_count; i++) {
+        if (record_history[i].col == RHYTHM_MOD_COL && record_history[i].pressed) return true;
+    }
+    return false;
+}
+
+static bool rhythm_key_shifted(void) {
+    for (uint8_t i = 0; i < record_count; i++) {
+        if (record_history[i].col == RHYTHM_KEY_COL && record_history[i].pressed) {
+            return (record_history[i].mods & MOD_BIT(KC_LSFT)) != 0;
+        }
+    }
+    return false;
+}
+
+static void rhythm_replay(const rhythm_trial *trial, rhythm_result *result) {
+    // the mocks start over for every trial, only the learned rhythm is kept
+#if SMTD_RHYTHM_MODEL
+    smtd_rhythm model = smtd_rhythm_model;
+    TEST_reset();
+    smtd_rhythm_model = model;
+    smtd_rhythm_model.typing = false;
+#else
+    TEST_reset();
+#endif
+
+    uint32_t tapped_at = 0;
+    for (uint8_t i = 0; i < trial->size; i++) {
+        const rhythm_event *event = &trial->events[i];
+        // step through the release window one ms at a time to see when the tap is sent
+        while (mock_time_ms < event->time) {
+            TEST_advance_time(1);
+            if (tapped_at == 0 && mock_time_ms > trial->mod_released && rhythm_mod_tapped()) {
+                tapped_at = mock_time_ms;
+            }
+        }
+        keyrecord_t record = {.event = MAKE_KEYEVENT(0, event->col, event->pressed)};
+        if (event->col == RHYTHM_MOD_COL || event->col == RHYTHM_KEY_COL) {
+            // the filler keys are done, only the ambiguous sequence is checked
+            if (event->col == RHYTHM_MOD_COL && event->pressed) record_count = 0;
+        }
+        process_smtd(keymaps[0][0][event->col], &record);
+        if (tapped_at == 0 && mock_time_ms >= trial->mod_released && rhythm_mod_tapped()) {
+            tapped_at = mock_time_ms;
+        }
+    }
+    TEST_advance_time(1000);
+
+    bool shifted = rhythm_key_shifted();
+    if (trial->hold) {
+        result->holds++;
+        if (!shifted) result->hold_misfires++;
+    } else {
+        result->rolls++;
+        if (shifted) {
+            result->roll_misfires++;
+        } else {
+            uint32_t latency = tapped_at - trial->mod_released;
+            result->latency_sum += latency;
+            if (latency > result->latency_max) result->latency_max = latency;
+        }
+    }
+}
+
+int main(void) {
+    // typing speed drifts over the day: average ms between presses per session
+    const uint32_t sessions[] = {110, 90, 140, 200, 160, 120, 250, 100};
+    rhythm_result total = {0};
+
+    printf("SMTD_RHYTHM_MODEL=%d, SMTD_GLOBAL_RELEASE_PERCENT=%d\n", SMTD_RHYTHM_MODEL, SMTD_GLOBAL_RELEASE_PERCENT);
+    printf("%-8s %8s %8s %8s %8s %10s %8s\n", "interval", "rolls", "misfire", "holds", "misfire", "avg lat", "max lat");
+    for (uint8_t s = 0; s < sizeof(sessions) / sizeof(sessions[0]); s++) {
+        rhythm_result result = {0};
+        for (uint32_t i = 0; i < RHYTHM_TRIALS_PER_SESSION; i++) {
+            rhythm_trial trial;
+            rhythm_build(&trial, sessions[s], rhythm_random() % 5 < 2);
+            rhythm_replay(&trial, &result);
+        }
+        uint32_t taps = result.rolls - result.roll_misfires;
+        printf("%-8u %8u %7.1f%% %8u %7.1f%% %8.1fms %6ums\n", sessions[s],
+               result.rolls, 100.0 * result.roll_misfires / result.rolls,
+               result.holds, 100.0 * result.hold_misfires / result.holds,
+               taps ? (double) result.latency_sum / taps : 0.0, result.latency_max);
+
+        total.rolls += result.rolls;
+        total.roll_misfires += result.roll_misfires;
+        total.holds += result.holds;
+        total.hold_misfires += result.hold_misfires;
+        total.latency_sum += result.latency_sum;
+        if (result.latency_max > total.latency_max) total.latency_max = result.latency_max;
+    }
+    uint32_t taps = total.rolls - total.roll_misfires;
+    printf("%-8s %8u %7.1f%% %8u %7.1f%% %8.1fms %6ums\n", "total",
+           total.rolls, 100.0 * total.roll_misfires / total.rolls,
+           total.holds, 100.0 * total.hold_misfires / total.holds,
+           taps ? (double) total.latency_sum / taps : 0.0, total.latency_max);
+    return 0;
+}
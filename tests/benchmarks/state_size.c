@@ -0,0 +1,62 @@
+/* sizeof / RAM report for the state pool.
+ *
+ * Prints the size of one smtd_state and of the engine's static data for the
+ * current configuration. `just state-size` builds it for the default and the
+ * SMTD_COMPACT_STATE layout, with the host's and with QMK's AVR struct flags
+ * (-fpack-struct -fshort-enums). Pointers stay host-sized there, so the
+ * default layout still reads larger than on an actual AVR build.
+ */
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 4
+#define MATRIX_COLS 12
+
+#define TAPPING_TERM 200
+
+#define TEST_QUIET
+#define SMTD_DEBUG(...)
+#define SMTD_DEBUG_INPUT(...)
+#define SMTD_DEBUG_FULL(...)
+
+#include "../unit/sm_td_bindings.c"
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {{{0}}};
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    return NULL;
+}
+
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
+
+int main(void) {
+    size_t pool = sizeof(smtd_states_pool);
+    size_t free_slots = sizeof(smtd_free_slots);
+    size_t position_index = sizeof(smtd_position_index);
+
+    printf("layout:             %s\n", SMTD_COMPACT_STATE ? "SMTD_COMPACT_STATE" : "default");
+    printf("sizeof(smtd_state): %zu bytes\n", sizeof(smtd_state));
+    printf("state pool:         %zu bytes (SMTD_POOL_SIZE=%d)\n", pool, SMTD_POOL_SIZE);
+    printf("free-slot stack:    %zu bytes\n", free_slots);
+    printf("position index:     %zu bytes (%dx%d matrix)\n", position_index, MATRIX_ROWS, MATRIX_COLS);
+    printf("total:              %zu bytes\n", pool + free_slots + position_index);
+    return 0;
+}
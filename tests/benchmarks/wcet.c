@@ -0,0 +1,192 @@
+/* Host worst-case execution time harness for process_smtd.
+ *
+ * Adversarial event sequences are replayed many times. For every call of
+ * process_smtd in a sequence the fastest of all repetitions is kept, which
+ * filters out preemption and cache noise of the host; the slowest call among
+ * those is the worst case of the sequence. Cycles come from the time stamp
+ * counter on x86 and are nanoseconds elsewhere.
+ *
+ * Sequences:
+ *   stack  - SMTD_POOL_SIZE mod-taps pressed together, released in reverse,
+ *            so the last release resolves every state in a single cascade
+ *   roll   - the same keys rolled: each press overlaps the previous release
+ *   random - pseudo-random presses, releases and pauses over the same keys
+ *
+ * Build and run with `just bench`.
+ */
+#define _POSIX_C_SOURCE 199309L
+#define SMTD_UNIT_TEST
+
+#ifndef SMTD_POOL_SIZE
+#define SMTD_POOL_SIZE 10
+#endif
+
+#define MATRIX_ROWS 1
+#define MATRIX_COLS (SMTD_POOL_SIZE + 1)
+
+#define TAPPING_TERM 200
+
+/* keep the engine's debug tracing and the mocks' output out of the measurement */
+#define TEST_QUIET
+#define SMTD_DEBUG(...)
+#define SMTD_DEBUG_INPUT(...)
+#define SMTD_DEBUG_FULL(...)
+
+#include <time.h>
+
+#include "../unit/sm_td_bindings.c"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define WCET_UNIT "cycles"
+static uint64_t wcet_now(void) {
+    return __rdtsc();
+}
+#else
+#define WCET_UNIT "ns"
+static uint64_t wcet_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+#endif
+
+#define WCET_REPEATS 2000
+#define WCET_MAX_EVENTS 128
+
+/* every key of the single row is the same mod-tap, columns 1..SMTD_POOL_SIZE are used */
+#define WCET_KEYCODE 100
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [0] = {{[0 ... MATRIX_COLS - 1] = WCET_KEYCODE}},
+};
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_MT(WCET_KEYCODE, KC_LSFT)
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    return NULL;
+}
+
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
+
+/* col 0 is a pause of `pause` ms instead of a key event */
+typedef struct {
+    uint8_t col;
+    bool pressed;
+    uint16_t pause;
+} wcet_event;
+
+typedef struct {
+    const char *name;
+    wcet_event events[WCET_MAX_EVENTS];
+    uint8_t size;
+} wcet_sequence;
+
+static void wcet_push(wcet_sequence *seq, uint8_t col, bool pressed, uint16_t pause) {
+    if (seq->size < WCET_MAX_EVENTS) {
+        seq->events[seq->size++] = (wcet_event) {col, pressed, pause};
+    }
+}
+
+static void wcet_build(wcet_sequence *stack, wcet_sequence *roll, wcet_sequence *random) {
+    stack->name = "stack";
+    for (uint8_t col = 1; col <= SMTD_POOL_SIZE; col++) wcet_push(stack, col, true, 0);
+    for (uint8_t col = SMTD_POOL_SIZE; col >= 1; col--) wcet_push(stack, col, false, 0);
+
+    roll->name = "roll";
+    wcet_push(roll, 1, true, 0);
+    for (uint8_t col = 2; col <= SMTD_POOL_SIZE; col++) {
+        wcet_push(roll, col, true, 0);
+        wcet_push(roll, 0, false, 15);
+        wcet_push(roll, col - 1, false, 0);
+    }
+    wcet_push(roll, SMTD_POOL_SIZE, false, 0);
+
+    random->name = "random";
+    bool down[MATRIX_COLS] = {false};
+    uint32_t rng = 0x5eed;
+    while (random->size < WCET_MAX_EVENTS - SMTD_POOL_SIZE) {
+        rng = rng * 1103515245u + 12345u;
+        uint8_t col = 1 + (rng >> 16) % SMTD_POOL_SIZE;
+        if ((rng >> 8) % 5 == 0) {
+            wcet_push(random, 0, false, (rng >> 4) % 250);
+            continue;
+        }
+        wcet_push(random, col, !down[col], 0);
+        down[col] = !down[col];
+    }
+    for (uint8_t col = 1; col <= SMTD_POOL_SIZE; col++) {
+        if (down[col]) wcet_push(random, col, false, 0);
+    }
+}
+
+static uint64_t wcet_run(const wcet_sequence *seq, uint8_t *worst_event) {
+    uint64_t best[WCET_MAX_EVENTS];
+    for (uint8_t i = 0; i < seq->size; i++) best[i] = UINT64_MAX;
+
+    for (uint32_t r = 0; r < WCET_REPEATS; r++) {
+        TEST_reset();
+        for (uint8_t i = 0; i < seq->size; i++) {
+            const wcet_event *event = &seq->events[i];
+            if (event->col == 0) {
+                TEST_advance_time(event->pause);
+                continue;
+            }
+
+            keyrecord_t record = {.event = MAKE_KEYEVENT(0, event->col, event->pressed)};
+            uint64_t started = wcet_now();
+            process_smtd(WCET_KEYCODE, &record);
+            uint64_t spent = wcet_now() - started;
+            if (spent < best[i]) best[i] = spent;
+
+            // the mocks keep a bounded history; the measurement does not need it
+            record_count = 0;
+        }
+        TEST_advance_time(1000);
+    }
+
+    uint64_t worst = 0;
+    for (uint8_t i = 0; i < seq->size; i++) {
+        if (seq->events[i].col != 0 && best[i] > worst) {
+            worst = best[i];
+            *worst_event = i;
+        }
+    }
+    return worst;
+}
+
+int main(void) {
+    static wcet_sequence stack, roll, random;
+    wcet_build(&stack, &roll, &random);
+    const wcet_sequence *sequences[] = {&stack, &roll, &random};
+
+    printf("SMTD_POOL_SIZE=%d, worst case per process_smtd call in " WCET_UNIT "\n", SMTD_POOL_SIZE);
+    printf("%-8s %8s %10s %12s\n", "sequence", "events", "worst", "at event");
+    for (uint8_t s = 0; s < sizeof(sequences) / sizeof(sequences[0]); s++) {
+        uint8_t worst_event = 0;
+        uint64_t worst = wcet_run(sequences[s], &worst_event);
+        printf("%-8s %8u %10llu %12u\n", sequences[s]->name, sequences[s]->size,
+               (unsigned long long) worst, worst_event);
+    }
+    return 0;
+}
@@ -35,3 +35,18 @@ uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
 bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
     return smtd_feature_enabled_default(keycode, feature);
 }
+
+/* Keyboard-level hook in front of sm_td, as in the manual install. It counts the
+ * records it would do its work for apart from the ones sm_td replays, so the tests
+ * can measure how often process_record_kb runs per physical key event. */
+uint16_t smtd_test_kb_records = 0;
+uint16_t smtd_test_kb_replays = 0;
+
+bool process_record_kb(uint16_t keycode, keyrecord_t *record) {
+    if (smtd_is_emulating()) {
+        smtd_test_kb_replays++;
+    } else {
+        smtd_test_kb_records++;
+    }
+    return process_record_user(keycode, record);
+}
@@ -448,3 +448,37 @@ TEST_F(SmTdFull, lt_hold_with_unmapped_follow_key) {
     idle_for(TAPPING_TERM + 50);
     EXPECT_TRUE(layer_state_is(0));
 }
+
+/* ---- replayed records ---- */
+extern "C" uint16_t smtd_test_kb_records;
+extern "C" uint16_t smtd_test_kb_replays;
+
+/* Each deferred tap reaches process_record_kb four times: the physical press and
+ * release, then the press and release sm_td replays. smtd_is_emulating() tells the
+ * replays apart, so keyboard work guarded by it runs twice per tap instead of four. */
+TEST_F(SmTdFull, kb_hook_tells_replayed_records_apart) {
+    TestDriver driver;
+    InSequence s;
+    KeymapKey a = KeymapKey(0, 0, 0, KC_A);   /* MT */
+    KeymapKey b = KeymapKey(0, 4, 0, KC_B);   /* plain */
+    set_keymap({a, b});
+    smtd_test_kb_records = 0;
+    smtd_test_kb_replays = 0;
+
+    EXPECT_REPORT(driver, (KC_A));
+    EXPECT_EMPTY_REPORT(driver);
+    EXPECT_REPORT(driver, (KC_B));
+    EXPECT_EMPTY_REPORT(driver);
+    a.press();
+    run_one_scan_loop();
+    a.release();
+    idle_for(TAPPING_TERM + 50);
+    b.press();
+    run_one_scan_loop();
+    b.release();
+    idle_for(TAPPING_TERM + 50);
+    VERIFY_AND_CLEAR(driver);
+
+    EXPECT_EQ(smtd_test_kb_records, 4);
+    EXPECT_EQ(smtd_test_kb_replays, 4);
+}
@@ -10,6 +10,7 @@
 #include "quantum.h"
 #include "sm_td.h"
 #include "keymap_introspection.h"
+#include "raw_hid.h"
 
 enum smtd_via_layers { L0 = 0, L1 = 1 };
 
@@ -33,6 +34,15 @@ uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
     return keycode_at_keymap_location(layer, key.row, key.col);
 }
 
+/* SMTD_VIA_KEYMAP_HOOK is off: hand VIA commands to sm_td the documented way. */
+bool via_command_kb(uint8_t *data, uint8_t length) {
+    smtd_via_command(data, length);
+    return false;
+}
+
+/* VIA answers every command over raw HID, which the test harness has no endpoint for. */
+void raw_hid_send(uint8_t *data, uint8_t length) {}
+
 /* Weak in sm_td.h; macOS ld rejects undefined-weak refs in an executable. */
 uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
     return get_smtd_timeout_default(timeout);
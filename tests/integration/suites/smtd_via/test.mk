@@ -12,6 +12,7 @@
 
 DEFERRED_EXEC_ENABLE = yes
 DYNAMIC_KEYMAP_ENABLE = yes
+VIA_ENABLE = yes
 SEND_STRING_ENABLE = yes
 
 OPT_DEFS += -DQMK_KEYBOARD_H=\"quantum.h\"
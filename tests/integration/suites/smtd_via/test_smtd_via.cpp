@@ -17,6 +17,8 @@
 
 extern "C" {
 #include "dynamic_keymap.h"
+#include "raw_hid.h"
+#include "via.h"
 void    smtd_reset(void);
 uint8_t get_mods(void);
 }
@@ -178,3 +180,30 @@ TEST_F(SmTdVia, live_remap_mod_tap_to_plain_drops_hold) {
         EXPECT_EQ(get_mods(), 0);
     }
 }
+
+/* A keymap write through VIA drops the keycode sm_td cached for a key still in its
+ * tap sequence: without it the second press would be another tap of A. */
+TEST_F(SmTdVia, via_keymap_write_drops_cached_keycode) {
+    TestDriver driver;
+    InSequence s;
+    dynamic_keymap_set_keycode(0, 0, 0, KC_A); /* MT tap -> A */
+    KeymapKey k = at(0, 0);
+
+    EXPECT_REPORT(driver, (KC_A));
+    EXPECT_EMPTY_REPORT(driver);
+    EXPECT_REPORT(driver, (KC_E));
+    EXPECT_EMPTY_REPORT(driver);
+    k.press();
+    run_one_scan_loop();
+    k.release();
+    run_one_scan_loop();
+
+    uint8_t data[32] = {id_dynamic_keymap_set_keycode, 0, 0, 0, KC_E >> 8, KC_E & 0xFF};
+    raw_hid_receive(data, sizeof(data));
+
+    k.press();
+    run_one_scan_loop();
+    k.release();
+    idle_for(TAPPING_TERM + 50);
+    VERIFY_AND_CLEAR(driver);
+}
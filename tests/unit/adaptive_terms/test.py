@@ -0,0 +1,187 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/adaptive_terms/layout.c')
+
+MOD_LSFT = 0x02
+SAVE_DELAY = 1000  # SMTD_ADAPTIVE_SAVE_DELAY_MS in layout.c
+MATRIX_COLS = 9
+
+
+def stored(key):
+    """(tap term in ms, release percent) of the key in the EEPROM user datablock, 0 means configured"""
+    offset = (key.row * MATRIX_COLS + key.col) * 2
+    return smtd.lib.TEST_get_user_datablock(offset) * 2, smtd.lib.TEST_get_user_datablock(offset + 1)
+
+
+class TestAdaptiveTerms(SmTdAssertions):
+    """SMTD_ADAPTIVE_TERMS tightens the tap term and release percent of each key
+    toward the user's confirmed decisions and widens them back on a miss"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        smtd.lib.TEST_clear_user_datablock()
+        reset()
+
+    def tap(self, key, duration):
+        key.press()
+        smtd.wait(duration)
+        key.release()
+
+    def confirmed_taps(self, key, duration, count):
+        """Taps followed by another key: the tap was meant"""
+        for _ in range(count):
+            self.tap(key, duration)
+            smtd.wait(50)
+            self.tap(K2, 30)
+            smtd.wait(500)
+        smtd.wait(SAVE_DELAY)
+        smtd.clear_record_history()
+
+    def confirmed_holds(self, key, release_gap, count):
+        """↓key ↓K2 ↑key ↑K2 resolved as holds and followed by another key"""
+        for _ in range(count):
+            key.press()
+            smtd.wait(40)
+            K2.press()
+            smtd.wait(80)
+            key.release()
+            smtd.wait(release_gap)
+            K2.release()
+            smtd.wait(50)
+            self.tap(K2, 30)
+            smtd.wait(500)
+        smtd.wait(SAVE_DELAY)
+        smtd.clear_record_history()
+
+    def test_confirmed_taps_tighten_tap_term(self):
+        self.confirmed_taps(K1, 60, 20)
+        tap_term, _ = stored(K1)
+        self.assertGreaterEqual(tap_term, 110)  # press duration + SMTD_ADAPTIVE_TAP_MARGIN_MS
+        self.assertLess(tap_term, 130)
+
+        # a 150ms press is a hold now
+        self.tap(K1, 150)
+        self.assertHistory()
+        # the other key keeps its configured term
+        self.tap(K3, 150)
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_backspace_rejects_tap(self):
+        for _ in range(20):
+            self.tap(K1, 60)
+            smtd.wait(50)
+            self.tap(BS, 30)
+            smtd.wait(500)
+        self.assertEqual(smtd.get_deferred_execs()[-1]["active"], False)
+        self.assertEqual(stored(K1), (0, 0))
+
+    def test_unconfirmed_tap_is_not_learned(self):
+        self.tap(K1, 60)
+        smtd.wait(SAVE_DELAY + 500)
+        self.tap(K2, 30)
+        smtd.wait(SAVE_DELAY)
+        self.assertEqual(stored(K1), (0, 0))
+
+    def test_early_lone_hold_release_widens_tap_term(self):
+        self.confirmed_taps(K1, 60, 20)
+        self.assertNotEqual(stored(K1)[0], 0)
+
+        # became a hold by the learned term, but came up before the configured one
+        self.tap(K1, 150)
+        smtd.wait(SAVE_DELAY)
+        self.assertEqual(stored(K1), (0, 0))
+
+        self.tap(K1, 150)
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_long_lone_hold_keeps_tap_term(self):
+        self.confirmed_taps(K1, 60, 20)
+        tap_term, _ = stored(K1)
+        K1.press()
+        smtd.wait(300)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K1.release()
+        smtd.wait(SAVE_DELAY)
+        self.assertEqual(stored(K1)[0], tap_term)
+
+    def test_confirmed_holds_tighten_release_percent(self):
+        """window = min(40, 80) * percent / 100 after ↑K1"""
+        self.confirmed_holds(K1, 1, 30)
+        _, percent = stored(K1)
+        self.assertGreaterEqual(percent, 12)  # 1 * 100 / 40 + SMTD_ADAPTIVE_RELEASE_MARGIN
+        self.assertLess(percent, 16)
+
+        # 7ms was inside the configured 8ms window
+        K1.press()
+        smtd.wait(40)
+        K2.press()
+        smtd.wait(80)
+        K1.release()
+        smtd.wait(7)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K2),
+            released(K2),
+        )
+
+    def test_terms_survive_reset(self):
+        self.confirmed_taps(K1, 60, 20)
+        tap_term, _ = stored(K1)
+        reset()
+        self.assertEqual(stored(K1)[0], tap_term)
+        self.tap(K1, 150)
+        smtd.wait(SAVE_DELAY)
+        self.assertHistory()
+
+    def test_adaptive_reset(self):
+        self.confirmed_taps(K1, 60, 20)
+        smtd.lib.smtd_adaptive_reset()
+        self.assertEqual(stored(K1), (0, 0))
+        self.tap(K1, 150)
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(8)] + \
+               [Keycode(smtd, 0x2A, 0, 8, 0)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LSFT)", all_keycodes)
+BS = Key(smtd, 'BS', 0, 8, "KC_BSPC", all_keycodes)
+
+all_keys = [K1, K2, K3, BS]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
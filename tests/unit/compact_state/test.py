@@ -0,0 +1,128 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/compact_state/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+MOD_LALT = 0x04
+
+
+class TestCompactState(SmTdAssertions):
+    """With SMTD_COMPACT_STATE the engine behaves exactly as with the default
+    layout, including when the 16-bit clock wraps around"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_tap(self):
+        K1.press()
+        smtd.wait(50)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_hold(self):
+        K1.press()
+        smtd.wait(250)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K4.press()
+        K4.release()
+        K1.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory(
+            pressed(K4, mods=MOD_LSFT),
+            released(K4, mods=MOD_LSFT),
+        )
+
+    def test_per_key_tap_term(self):
+        # there is no snapshot in the compact layout, the hook is asked directly
+        K3.press()
+        smtd.wait(49)
+        self.assertEqual(smtd.get_mods(), 0)
+        smtd.wait(1)
+        self.assertEqual(smtd.get_mods(), MOD_LALT)
+
+        K3.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_nested_holds_keep_list_order(self):
+        K1.press()
+        smtd.wait(10)
+        K2.press()
+        smtd.wait(10)
+        K3.press()
+        smtd.wait(10)
+        K4.press()
+        K4.release()
+        self.assertEqual(smtd.get_mods(), MOD_LSFT | MOD_LCTL | MOD_LALT)
+
+        K3.release()
+        K2.release()
+        K1.release()
+        smtd.wait(500)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory(
+            pressed(K4, mods=MOD_LSFT | MOD_LCTL | MOD_LALT),
+            released(K4, mods=MOD_LSFT | MOD_LCTL | MOD_LALT),
+        )
+
+    def test_hold_across_clock_wrap(self):
+        smtd.wait(65500)
+
+        K1.press()
+        smtd.wait(100)  # the 16-bit clock wraps here
+        self.assertEqual(smtd.get_mods(), 0, "still within tapping term")
+        smtd.wait(100)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+
+        K1.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_tap_across_clock_wrap(self):
+        smtd.wait(65500)
+
+        K1.press()
+        smtd.wait(100)
+        K1.release()
+        smtd.wait(500)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LALT), tap term 50", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -55,6 +55,18 @@ class TestSmTd(SmTdAssertions):
         self.assertEqual(len(records), 2)
         self.assertEmulateRelease(records[1], K2)
 
+    def test_only_replays_are_emulating(self):
+        """Replayed records have smtd_is_emulating() set, and only while they run"""
+        MT1.press()
+        MT1.release()
+        self.assertEqual(smtd.get_emulated_record_count(), 2)
+
+        K2.press()
+        K2.release()
+        self.assertEqual(smtd.get_emulated_record_count(), 4)
+        self.assertEqual(len(smtd.get_record_history()), 4)
+        self.assertFalse(smtd.lib.smtd_is_emulating())
+
     def test_basic_MT_ON_MKEY_tap(self):
         """Test the basic MT function"""
         self.assertFalse(MMT.press(), "press should block future key events")
@@ -259,6 +271,32 @@ class TestSmTd(SmTdAssertions):
         self.assertEmulatePress(records[0], K1, layer_state=1)
         self.assertEmulateRelease(records[1], K1, layer_state=1)
 
+    def test_LT_key_tapped_on_layer(self):
+        LT1.press()
+        MMT.press()
+        MMT.release()
+        LT1.release()
+
+        # the macro key is resolved on layer 1, not on the layer it was pressed on
+        self.assertHistory(
+            EmulatePress(MMT, layer=1),
+            EmulateRelease(MMT, layer=1),
+        )
+
+    def test_LT_LT_layer_switch(self):
+        LT1.press()
+        LT2.press()
+        K1.press()
+        K1.release()
+        LT2.release()
+        LT1.release()
+
+        # LT2 holds to layer 3 from layer 1
+        self.assertHistory(
+            EmulatePress(K1, layer=3),
+            EmulateRelease(K1, layer=3),
+        )
+
     def test_instant_bypass(self):
         K1.press()
         # fixme вот тут можно было бы и отпускать процесс, а не стопорить и эмулировать нажатие
@@ -0,0 +1,122 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/event_time/layout.c')
+
+MOD_LSFT = 0x02
+
+# (event lag, exec lag): how much later than their timestamp / deadline key
+# events and deferred execs get processed. An exec never runs earlier than the
+# events stamped before its deadline, like in QMK's main loop.
+LAGS = [(0, 0), (0, 30), (15, 15), (5, 40), (0, 150)]
+
+
+class TestEventTime(SmTdAssertions):
+    """Tap / hold decisions follow record->event.time and timeout deadlines,
+    so the same input trace gives the same output however late it is processed"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def run_trace(self, trace, event_lag, exec_lag, start=1000):
+        """Replays (time, key, pressed) events, each processed event_lag after its time"""
+        reset()
+        smtd.wait(start)
+        smtd.set_lag(event_lag, exec_lag)
+        now = 0
+        for time, key, press in trace:
+            smtd.wait(time + event_lag - now)
+            now = time + event_lag
+            if press:
+                key.press()
+            else:
+                key.release()
+        smtd.wait(1000)
+        smtd.set_lag(0, 0)
+        return smtd.get_record_history()
+
+    def assertTraceStable(self, trace, start=1000):
+        expected = self.run_trace(trace, 0, 0, start)
+        for event_lag, exec_lag in LAGS:
+            self.assertEqual(self.run_trace(trace, event_lag, exec_lag, start), expected,
+                             f"event lag {event_lag}, exec lag {exec_lag}")
+        return expected
+
+    def test_late_timeout_still_decides_hold(self):
+        """The tap term is over when the key is released, even if the timeout hasn't run yet"""
+        smtd.set_lag(0, 30)
+        K1.press()
+        smtd.wait(215)
+        K1.release()
+        smtd.wait(100)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_late_timeout_fires_before_following_key(self):
+        smtd.set_lag(0, 30)
+        K1.press()
+        smtd.wait(210)
+        K2.press()
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K2.release()
+        K1.release()
+        smtd.wait(100)
+        self.assertHistory(
+            pressed(K2, mods=MOD_LSFT),
+            released(K2, mods=MOD_LSFT),
+        )
+
+    def test_tap_before_tap_term(self):
+        history = self.assertTraceStable([(0, K1, True), (199, K1, False)])
+        self.assertEqual(len(history), 2)
+
+    def test_hold_after_tap_term(self):
+        history = self.assertTraceStable([(0, K1, True), (201, K1, False)])
+        self.assertEqual(history, [])
+
+    def test_dynamic_release_window_inside(self):
+        """window = min(40, 80) * 20% = 8ms after ↑K1"""
+        history = self.assertTraceStable([(0, K1, True), (40, K2, True), (120, K1, False), (127, K2, False)])
+        self.assertEqual([h["mods"] for h in history], [MOD_LSFT, MOD_LSFT])
+
+    def test_dynamic_release_window_outside(self):
+        history = self.assertTraceStable([(0, K1, True), (40, K2, True), (120, K1, False), (129, K2, False)])
+        self.assertEqual([h["mods"] for h in history], [0, 0, 0, 0])
+
+    def test_layer_hold(self):
+        history = self.assertTraceStable([(0, K3, True), (50, K2, True), (90, K2, False), (150, K3, False)])
+        self.assertEqual([h["layer_state"] for h in history], [1, 1])
+
+    def test_timestamps_wrap(self):
+        """16-bit event timestamps are widened across the wrap of timer_read()"""
+        trace = [(0, K1, True), (40, K2, True), (120, K1, False), (127, K2, False)]
+        self.assertEqual(self.assertTraceStable(trace, start=65500), self.run_trace(trace, 0, 0))
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_LT(L0_KC3, L1)", all_keycodes)
+
+all_keys = [K1, K2, K3]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
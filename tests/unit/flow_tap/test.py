@@ -0,0 +1,231 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/flow_tap/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestFlowTap(SmTdAssertions):
+    """SMTD_GLOBAL_FLOW_TAP_TERM (150ms) resolves a tap-hold key pressed that soon
+    after the previous tap as a tap on the press"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def type_plain(self):
+        """The streak starts with the press of K2, 30ms before this returns"""
+        K2.press()
+        smtd.wait(30)
+        K2.release()
+        smtd.clear_record_history()
+
+    def test_tap_sent_on_press_during_streak(self):
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        smtd.wait(30)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_held_during_streak_is_still_a_tap(self):
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        smtd.wait(500)
+        self.assertEqual(smtd.get_mods(), 0)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_hold_after_pause(self):
+        self.type_plain()
+        smtd.wait(120)
+        K1.press()
+        self.assertHistory()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K1.release()
+        self.assertHistory()
+
+    def test_no_streak_without_previous_tap(self):
+        K1.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K1.release()
+        self.assertHistory()
+
+    def test_hold_ends_streak(self):
+        K1.press()
+        smtd.wait(210)
+        K1.release()
+        smtd.wait(50)
+        K4.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K4.release()
+        self.assertHistory()
+
+    def test_streak_goes_on(self):
+        """Every flow tap extends the streak for the next key"""
+        self.type_plain()
+        smtd.wait(100)
+        K1.press()
+        smtd.wait(30)
+        K1.release()
+        smtd.wait(100)
+        K4.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K4),
+            released(K4),
+        )
+        smtd.wait(30)
+        K4.release()
+
+    def test_roll_after_flow_tap(self):
+        """The flow tapped key doesn't hold back the following ones"""
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        smtd.wait(30)
+        K2.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K2),
+        )
+        smtd.wait(30)
+        K1.release()
+        smtd.wait(30)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K2),
+            released(K2),
+        )
+
+    def test_release_after_other_key_is_consumed(self):
+        """A key pressed while the flow tapped key is held ends its sequence, not its state"""
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        smtd.wait(30)
+        K2.press()
+        self.assertEqual(active_states(), 2, "the flow tapped state waits for its release")
+        smtd.wait(30)
+        K1.release()
+        self.assertEqual(active_states(), 1, "its release ends it without a sequence")
+        smtd.wait(30)
+        K2.release()
+        smtd.wait(500)
+        self.assertEqual(active_states(), 0)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K2),
+            released(K2),
+        )
+
+    def test_second_tap_of_sequence(self):
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        smtd.wait(30)
+        K1.release()
+        smtd.wait(30)
+        K1.press()
+        smtd.wait(30)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_long_hold_keeps_sequence(self):
+        """The sequence term of a flow tapped key runs from its release, not its press"""
+        self.type_plain()
+        smtd.wait(50)
+        K1.press()
+        smtd.wait(500)
+        K1.release()
+        smtd.wait(30)
+        K1.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), 0)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_disabled_per_key(self):
+        self.type_plain()
+        smtd.wait(50)
+        K3.press()
+        self.assertHistory()
+        smtd.wait(100)
+        K2.press()
+        smtd.wait(30)
+        K2.release()
+        self.assertEqual(smtd.get_layer_state(), 1)
+        K3.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K2, layer=1),
+            released(K2, layer=1),
+        )
+
+
+def active_states():
+    return ctypes.c_uint8.in_dll(smtd.lib, 'smtd_active_states_size').value
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_LT(L0_KC3, L1), no flow taps", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_MT(L0_KC4, KC_LSFT)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
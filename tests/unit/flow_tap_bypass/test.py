@@ -0,0 +1,94 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/flow_tap_bypass/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+
+
+class TestFlowTapBypass(SmTdAssertions):
+    """With SMTD_BYPASS_UNMANAGED, a plain key left to QMK starts the typing
+    streak of SMTD_GLOBAL_FLOW_TAP_TERM (150ms) like one typed through sm_td"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_passed_key_starts_streak(self):
+        self.assertTrue(K3.press())
+        smtd.wait(30)
+        self.assertTrue(K3.release())
+        smtd.wait(50)
+        K1.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        smtd.wait(300)
+        self.assertEqual(smtd.get_mods(), 0)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_passed_key_after_pause_leaves_hold(self):
+        K3.press()
+        smtd.wait(30)
+        K3.release()
+        smtd.wait(300)
+        K1.press()
+        smtd.wait(250)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory()
+
+    def test_key_passed_under_hold_starts_streak(self):
+        K1.press()
+        smtd.wait(250)
+        self.assertTrue(K3.press(), "the hold has settled, so the key passes")
+        smtd.wait(30)
+        K3.release()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(50)
+        K2.press()
+        smtd.wait(300)
+        self.assertEqual(smtd.get_mods(), 0)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K2),
+            released(K2),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain, unmanaged", all_keycodes)
+
+all_keys = [K1, K2, K3]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,140 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/hold_on_other_key_press/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestHoldOnOtherKeyPress(SmTdAssertions):
+    """SMTD_FEATURE_HOLD_ON_OTHER_KEY_PRESS holds an undecided key on the press
+    of any other key"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_layer_key_sent_on_press(self):
+        K1.press()
+        smtd.wait(20)
+        K2.press()
+        self.assertEqual(smtd.get_layer_state(), 1)
+        self.assertHistory(
+            pressed(K2, layer=1),
+        )
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(20)
+        K1.release()
+        self.assertEqual(smtd.get_layer_state(), 0)
+        self.assertHistory(
+            pressed(K2, layer=1),
+            released(K2, layer=1),
+        )
+
+    def test_roll_holds(self):
+        """↓K3 ↓K2 ↑K3 ↑K2 outside the release window is still a hold"""
+        K3.press()
+        smtd.wait(40)
+        K2.press()
+        smtd.wait(40)
+        K3.release()
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K2, mods=MOD_LSFT),
+            released(K2),
+        )
+
+    def test_lone_tap(self):
+        K1.press()
+        smtd.wait(20)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_disabled_per_key(self):
+        K4.press()
+        smtd.wait(20)
+        K2.press()
+        self.assertHistory()
+        smtd.wait(20)
+        K4.release()
+        smtd.wait(100)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K4),
+            released(K4),
+            pressed(K2),
+            released(K2),
+        )
+
+    def test_keys_in_between_keep_order(self):
+        """K4 is still undecided, so the hold of K3 waits for it"""
+        K4.press()
+        smtd.wait(20)
+        K3.press()
+        smtd.wait(20)
+        K2.press()
+        self.assertHistory()
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(20)
+        K3.release()
+        smtd.wait(20)
+        K4.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K2, mods=MOD_LSFT),
+            released(K2, mods=MOD_LSFT),
+        )
+
+    def test_held_key_flushes_the_ones_behind(self):
+        """↓K3 ↓K4 ↓K2: the press of K4 holds K3, K4 decides on its own"""
+        K3.press()
+        smtd.wait(20)
+        K4.press()
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        smtd.wait(20)
+        K4.release()
+        smtd.wait(20)
+        K3.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K4, mods=MOD_LSFT),
+            released(K4, mods=MOD_LSFT),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_LT(L0_KC1, L1), hold on other key press", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LSFT), hold on other key press", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_MT(L0_KC4, KC_LSFT)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
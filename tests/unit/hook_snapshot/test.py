@@ -0,0 +1,124 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/hook_snapshot/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+
+TIMEOUTS = 4
+FEATURES = 5
+
+
+class TestHookSnapshot(SmTdAssertions):
+    """get_smtd_timeout and smtd_feature_enabled are evaluated once per state,
+    when its desired keycode is known, and later decisions read the snapshot.
+    A key pressed while another one is undetermined is evaluated on press and
+    again when its first action runs, on the layer it runs on"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def assertHookCalls(self, states):
+        self.assertEqual(smtd.lib.TEST_get_timeout_calls(), TIMEOUTS * states)
+        self.assertEqual(smtd.lib.TEST_get_feature_calls(), FEATURES * states)
+
+    def test_sequence_of_taps_evaluates_hooks_once(self):
+        for _ in range(5):
+            K1.press()
+            smtd.wait(10)
+            K1.release()
+            smtd.wait(10)
+        smtd.wait(500)
+
+        self.assertHookCalls(1)
+
+    def test_roll_evaluates_hooks_once_per_state(self):
+        K1.press()
+        smtd.wait(10)
+        K3.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(10)
+        K3.release()
+        smtd.wait(500)
+
+        # K3 waits for K1, so it is evaluated again when its touch runs
+        self.assertHookCalls(3)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_per_key_tap_term_applies_to_first_touch(self):
+        K2.press()
+        smtd.wait(49)
+        self.assertEqual(smtd.get_mods(), 0)
+        smtd.wait(1)
+        self.assertEqual(smtd.get_mods(), MOD_LCTL)
+
+        K2.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_default_tap_term_for_other_keys(self):
+        K1.press()
+        smtd.wait(199)
+        self.assertEqual(smtd.get_mods(), 0)
+        smtd.wait(1)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+
+        K1.release()
+        self.assertHistory()
+
+    def test_deferred_key_takes_tap_term_of_its_layer(self):
+        K4.press()
+        smtd.wait(10)
+        K3.press()  # plain on layer 0, tap term 50 on layer 1
+        smtd.wait(189)
+        self.assertEqual(smtd.get_layer_state(), 0)
+        self.assertEqual(smtd.get_mods(), 0)
+
+        # the layer 1 tap term has already passed when K4 turns into a hold
+        smtd.wait(1)
+        self.assertEqual(smtd.get_layer_state(), 1)
+        self.assertEqual(smtd.get_mods(), MOD_LCTL)
+
+        K3.release()
+        K4.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertEqual(smtd.get_layer_state(), 0)
+        self.assertHistory()
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL), tap term 50", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain, SMTD_MT(L1_KC3, KC_LCTL) with tap term 50 on layer 1", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_LT(L0_KC4, L1)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+    smtd.lib.TEST_reset_hook_calls()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,89 @@
+/* Layout for sm_td keycode cache tests: the keymap can be rewritten at runtime
+ * (like a VIA / Vial dynamic keymap) and every keymap read is counted */
+#define SMTD_UNIT_TEST
+
+/* VIA command ids that write the keymap (mirror via.h) */
+#define VIA_ENABLE
+enum via_command_id {
+    id_dynamic_keymap_get_keycode = 0x04,
+    id_dynamic_keymap_set_keycode = 0x05,
+    id_dynamic_keymap_reset = 0x06,
+    id_eeprom_reset = 0x0A,
+    id_dynamic_keymap_set_buffer = 0x13,
+};
+
+#define MATRIX_ROWS 5
+#define MATRIX_COLS 9
+
+#define TAPPING_TERM 200
+
+#define SMTD_LAYOUT_DEFINES_KEYMAP_LOOKUP
+
+#define SMTD_VIA_KEYMAP_HOOK 1
+
+#include "../sm_td_bindings.c"
+
+enum LAYERS { L0 = 0, L1 = 1 };
+
+enum KEYCODES {
+    L0_KC0 = 100, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8,//
+    L1_KC0 = 200, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8,//
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [L0] = { L0_KC0, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8, },
+    [L1] = { L1_KC0, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8, },
+};
+
+static uint16_t dynamic_keymap[2][MATRIX_ROWS][MATRIX_COLS];
+static uint32_t keymap_reads = 0;
+
+uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
+    keymap_reads++;
+    return dynamic_keymap[layer][key.row][key.col];
+}
+
+void TEST_load_keymap(void) {
+    memcpy(dynamic_keymap, keymaps, sizeof(dynamic_keymap));
+    keymap_reads = 0;
+}
+
+void TEST_set_keycode(uint8_t layer, uint8_t row, uint8_t col, uint16_t keycode) {
+    dynamic_keymap[layer][row][col] = keycode;
+}
+
+uint32_t TEST_get_keymap_reads(void) {
+    return keymap_reads;
+}
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_MT(L0_KC1, KC_LSFT)
+        SMTD_LT(L0_KC2, L1)
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    static char buffer[16];
+    TEST_snprintf(buffer, sizeof(buffer), "KC_%d", keycode);
+    return buffer;
+}
+
+// Post-function implementations (no special behavior in this suite)
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
@@ -0,0 +1,157 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/keycode_cache/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestKeycodeCache(SmTdAssertions):
+    """A state reads the keymap at its pressed position once per highest layer,
+    not on every action"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def keymap_reads(self):
+        return smtd.lib.TEST_get_keymap_reads()
+
+    def remap(self, key, keycode, layer=0):
+        smtd.lib.TEST_set_keycode(layer, key.row, key.col, keycode.value)
+
+    def test_sequence_taps_read_keymap_once(self):
+        for _ in range(5):
+            K1.press()
+            smtd.wait(10)
+            K1.release()
+            smtd.wait(10)
+        smtd.wait(500)
+
+        # the emulated presses and releases are read by the mocked pipeline
+        pipeline_reads = len(smtd.get_record_history())
+        self.assertEqual(self.keymap_reads() - pipeline_reads, 1)
+
+    def test_layer_change_resolves_again(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()  # resolved under layer 0
+        smtd.wait(10)
+        smtd.lib.layer_on(1)
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.lib.layer_off(1)
+        smtd.wait(500)
+
+        # on layer 1 the position holds another key, so the second tap is sent directly
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(L0_KC1, layer=1),
+            unregistered(L0_KC1, layer=1),
+        )
+
+    def test_remap_is_cached_until_keymap_changed(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(10)
+        self.remap(K1, L0_KC8)
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        # the cached keycode still matches, so both taps take the pipeline
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_keymap_changed_drops_cache(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(10)
+        self.remap(K1, L0_KC8)
+        smtd.lib.smtd_keymap_changed()
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        # the position no longer resolves to the tapped key, so it is sent directly
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(L0_KC1),
+            unregistered(L0_KC1),
+        )
+
+    def test_via_keymap_write_drops_cache(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(10)
+        self.remap(K1, L0_KC8)
+        smtd.lib.via_command_kb(bytes([0x05, 0, 0, 1, 0, 108]), 6)  # id_dynamic_keymap_set_keycode
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(L0_KC1),
+            unregistered(L0_KC1),
+        )
+
+    def test_via_keymap_read_keeps_cache(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(10)
+        smtd.lib.via_command_kb(bytes([0x04, 0, 0, 1]), 4)  # id_dynamic_keymap_get_keycode
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        pipeline_reads = len(smtd.get_record_history())
+        self.assertEqual(self.keymap_reads() - pipeline_reads, 1)
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+L0_KC1 = all_keycodes[1]
+L0_KC8 = all_keycodes[8]
+L1_KC1 = all_keycodes[9 + 1]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_LT(L0_KC2, L1)", all_keycodes)
+
+all_keys = [K1, K2]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+    smtd.lib.TEST_load_keymap()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,82 @@
+/* Layout for sm_td learned unhandled keycode tests: plain keycodes are learned
+ * from their first touch and bypass sm_td afterwards */
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 5
+#define MATRIX_COLS 9
+
+#define TAPPING_TERM 200
+
+#define SMTD_LEARN_UNHANDLED 1
+
+/* VIA command ids that write the keymap (mirror via.h) */
+#define VIA_ENABLE
+enum via_command_id {
+    id_dynamic_keymap_set_keycode = 0x05,
+    id_dynamic_keymap_reset = 0x06,
+    id_eeprom_reset = 0x0A,
+    id_dynamic_keymap_set_buffer = 0x13,
+};
+
+#define SMTD_VIA_KEYMAP_HOOK 1
+
+#include "../sm_td_bindings.c"
+
+enum LAYERS { L0 = 0, L1 = 1 };
+
+enum KEYCODES {
+    L0_KC0 = 100, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8,//
+    L1_KC0 = 200, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8,//
+};
+
+#define KC_LCTL 0xE0
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [L0] = { L0_KC0, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8, },
+    [L1] = { L1_KC0, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8, },
+};
+
+static uint32_t unmanaged_actions = 0;
+
+uint32_t TEST_get_unmanaged_actions(void) {
+    return unmanaged_actions;
+}
+
+void TEST_reset_unmanaged_actions(void) {
+    unmanaged_actions = 0;
+}
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_MT(L0_KC1, KC_LSFT)
+        SMTD_MT(L0_KC2, KC_LCTL)
+        SMTD_MT(L1_KC3, KC_LCTL)
+        SMTD_LT(L0_KC4, L1)
+    }
+    unmanaged_actions++;
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    static char buffer[16];
+    TEST_snprintf(buffer, sizeof(buffer), "KC_%d", keycode);
+    return buffer;
+}
+
+// Post-function implementations (no special behavior in this suite)
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
@@ -0,0 +1,193 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/learn_unhandled/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+
+
+class TestLearnUnhandled(SmTdAssertions):
+    """With SMTD_LEARN_UNHANDLED, a keycode whose first touch is left unhandled
+    by on_smtd_action is remembered, and its later presses skip sm_td"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def unhandled_actions(self):
+        return smtd.lib.TEST_get_unmanaged_actions()
+
+    def test_plain_key_is_learned_on_first_press(self):
+        self.assertFalse(K3.press())
+        self.assertFalse(K3.release())
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+        self.assertEqual(self.unhandled_actions(), 2)
+        smtd.wait(500)
+
+        smtd.clear_record_history()
+        self.assertTrue(K3.press())
+        self.assertTrue(K3.release())
+        self.assertHistory()
+        self.assertEqual(self.unhandled_actions(), 2)
+
+    def test_managed_key_is_not_learned(self):
+        for _ in range(2):
+            self.assertFalse(K1.press())
+            smtd.wait(10)
+            self.assertFalse(K1.release())
+            smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_learned_key_is_queued_behind_pending_key(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.clear_record_history()
+
+        K1.press()
+        smtd.wait(10)
+        self.assertFalse(K3.press())
+        smtd.wait(10)
+        K3.release()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LSFT),
+            released(K3, mods=MOD_LSFT),
+        )
+        self.assertEqual(self.unhandled_actions(), 2, "the queued press skipped on_smtd_action")
+
+    def test_learned_key_passes_over_held_key(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.clear_record_history()
+
+        K1.press()
+        smtd.wait(250)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        self.assertTrue(K3.press())
+        self.assertTrue(K3.release())
+        self.assertTrue(K3.press(), "no tap sequence is kept for a passed key")
+        self.assertTrue(K3.release())
+        K1.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_queued_learned_key_keeps_no_sequence(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.clear_record_history()
+
+        K1.press()
+        smtd.wait(10)
+        self.assertFalse(K3.press())
+        self.assertFalse(K3.release())
+        K1.release()
+        self.assertTrue(K3.press())
+        self.assertTrue(K3.release())
+
+        self.assertHistory(
+            pressed(K3, MOD_LSFT),
+            released(K3, MOD_LSFT),
+        )
+
+    def test_keymap_changed_forgets_learned_keys(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.lib.smtd_keymap_changed()
+        smtd.clear_record_history()
+
+        self.assertFalse(K3.press())
+        self.assertFalse(K3.release())
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_via_keymap_write_forgets_learned_keys(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.lib.via_command_kb(bytes([0x06]), 1)  # id_dynamic_keymap_reset
+        smtd.clear_record_history()
+
+        self.assertFalse(K3.press())
+        self.assertFalse(K3.release())
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_learned_key_is_managed_on_layer_of_pending_key(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+        smtd.clear_record_history()
+
+        K4.press()
+        smtd.wait(10)
+        K3.press()  # learned as plain on layer 0, SMTD_MT on layer 1
+        smtd.wait(250)
+        self.assertEqual(smtd.get_layer_state(), 1)
+        self.assertEqual(smtd.get_mods(), MOD_LCTL)
+
+        K3.release()
+        K4.release()
+        smtd.wait(500)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertEqual(smtd.get_layer_state(), 0)
+        self.assertHistory()
+
+    def test_release_passes_after_forgetting_held_key(self):
+        K3.press()
+        K3.release()
+        smtd.wait(500)
+
+        self.assertTrue(K3.press())
+        smtd.lib.smtd_keymap_changed()
+        self.assertTrue(K3.release(), "a passed press must not lose its release")
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain, SMTD_MT(L1_KC3, KC_LCTL) on layer 1", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_LT(L0_KC4, L1)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+    smtd.lib.TEST_reset_unmanaged_actions()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,73 @@
+/* Layout for sm_td macro stream tests: a tap streams a string followed by a
+ * keycode, and keys typed meanwhile wait behind the stream. Another tap streams
+ * a stack buffer longer than the character buffer and overwrites it at once */
+#define SMTD_UNIT_TEST
+
+#define SMTD_MACRO_STREAM 1
+#define SMTD_STREAM_SIZE 4
+#define SMTD_STREAM_HELD_SIZE 2
+#define SMTD_STREAM_CHARS_SIZE 4
+
+#define MATRIX_ROWS 5
+#define MATRIX_COLS 9
+
+#define TAPPING_TERM 200
+
+#include "../sm_td_bindings.c"
+
+enum LAYERS { L0 = 0, L1 = 1 };
+
+enum KEYCODES {
+    L0_KC0 = 100, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8,//
+    L1_KC0 = 200, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8,//
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [L0] = { L0_KC0, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8, },
+    [L1] = { L1_KC0, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8, },
+};
+
+static void stream_from_stack(void) {
+    char buffer[8];
+    TEST_snprintf(buffer, sizeof(buffer), "%s", "defgh");
+    smtd_stream_string(buffer);
+    memset(buffer, '!', sizeof(buffer) - 1);
+}
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_DANCE(L0_KC1,
+            NOTHING,
+            EXEC(
+                smtd_stream_string("abc");
+                SMTD_TAP_16(false, L0_KC8);
+            ),
+            NOTHING,
+            NOTHING
+        )
+        SMTD_MT(L0_KC2, KC_LSFT)
+        SMTD_DANCE(L0_KC5,
+            NOTHING,
+            EXEC(stream_from_stack();),
+            NOTHING,
+            NOTHING
+        )
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    static char buffer[16];
+    TEST_snprintf(buffer, sizeof(buffer), "KC_%d", keycode);
+    return buffer;
+}
+
+// Post-function implementations (no special behavior in this suite)
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
@@ -0,0 +1,127 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/macro_stream/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestMacroStream(SmTdAssertions):
+    """Streamed output is sent one step per tick, and everything that comes
+    after it, sm_td output and new key events alike, waits behind it"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_string_is_sent_one_char_per_tick(self):
+        K1.press()
+        K1.release()
+        self.assertTrue(smtd.lib.smtd_stream_active())
+        self.assertHistory()
+
+        smtd.wait(1)
+        self.assertHistory(*tapped(A))
+        smtd.wait(2)
+        self.assertHistory(*tapped(A), *tapped(B), *tapped(C))
+        smtd.wait(1)
+        self.assertHistory(*tapped(A), *tapped(B), *tapped(C), *tapped(L0_KC8))
+        self.assertFalse(smtd.lib.smtd_stream_active())
+
+    def test_keys_typed_during_stream_wait_behind_it(self):
+        K1.press()
+        K1.release()
+        self.assertFalse(K4.press())
+        self.assertFalse(K4.release())
+        self.assertHistory()
+
+        smtd.wait(10)
+        self.assertHistory(
+            *tapped(A), *tapped(B), *tapped(C), *tapped(L0_KC8),
+            pressed(K4),
+            released(K4),
+        )
+
+    def test_mod_tap_held_during_stream_applies_after_it(self):
+        K1.press()
+        K1.release()
+        K2.press()
+        K4.press()
+        K4.release()
+        K2.release()
+        smtd.wait(10)
+
+        self.assertHistory(
+            *tapped(A), *tapped(B), *tapped(C), *tapped(L0_KC8),
+            pressed(K4, MOD_LSFT),
+            released(K4, MOD_LSFT),
+        )
+
+    def test_string_is_copied(self):
+        """The caller's buffer is gone right away, what doesn't fit is sent early"""
+        K5.press()
+        K5.release()
+        self.assertHistory(*tapped(D))
+
+        smtd.wait(10)
+        self.assertHistory(*tapped(D), *tapped(E), *tapped(F), *tapped(G), *tapped(H))
+        self.assertFalse(smtd.lib.smtd_stream_active())
+
+    def test_full_held_buffer_drains_stream_right_away(self):
+        K1.press()
+        K1.release()
+        K4.press()
+        K4.release()
+        K3.press()
+
+        self.assertFalse(smtd.lib.smtd_stream_active())
+        self.assertHistory(
+            *tapped(A), *tapped(B), *tapped(C), *tapped(L0_KC8),
+            pressed(K4),
+            released(K4),
+            pressed(K3),
+        )
+        K3.release()
+
+
+class Code:
+    def __init__(self, value):
+        self.value = value
+
+
+def tapped(keycode):
+    return [Register(keycode), Unregister(keycode)]
+
+
+A, B, C = Code(ord('a')), Code(ord('b')), Code(ord('c'))
+D, E, F, G, H = (Code(ord(char)) for char in 'defgh')
+L0_KC8 = Code(108)
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "streams \"abc\" and L0_KC8 on tap", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LSFT)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+K5 = Key(smtd, 'K5', 0, 5, "streams \"defgh\" from a stack buffer on tap", all_keycodes)
+
+all_keys = [K1, K2, K3, K4, K5]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
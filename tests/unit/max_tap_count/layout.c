@@ -0,0 +1,77 @@
+/* Layout configuration for sm_td tests: tap sequences that end as soon as the
+ * last meaningful tap count is reached */
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 5
+#define MATRIX_COLS 9
+
+#define TAPPING_TERM 200
+
+#include "../sm_td_bindings.c"
+
+enum LAYERS { L0 = 0, L1 = 1 };
+
+enum KEYCODES {
+    L0_KC0 = 100, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8,//
+    L1_KC0 = 200, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8,//
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [L0] = { L0_KC0, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8, },
+    [L1] = { L1_KC0, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8, },
+};
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_DANCE(L0_KC1,
+            NOTHING,
+            SMTD_TAP_16(false, tap_count == 0 ? L1_KC1 : L1_KC2),
+            NOTHING,
+            NOTHING
+        )
+        SMTD_MT(L0_KC3, KC_LSFT)
+        SMTD_MT(L0_KC4, KC_LSFT)
+        SMTD_DANCE(L0_KC5,
+            NOTHING,
+            SMTD_TAP_16(false, L1_KC5),
+            NOTHING,
+            NOTHING
+        )
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    if (feature == SMTD_FEATURE_AGGREGATE_TAPS) {
+        return keycode == L0_KC1 || keycode == L0_KC5;
+    }
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+uint8_t get_smtd_max_tap_count(uint16_t keycode) {
+    switch (keycode) {
+        SMTD_MAX_TAPS(L0_KC1, 2)
+        SMTD_MAX_TAPS(L0_KC3, 1)
+    }
+    return SMTD_GLOBAL_MAX_TAP_COUNT;
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    static char buffer[16];
+    TEST_snprintf(buffer, sizeof(buffer), "KC_%d", keycode);
+    return buffer;
+}
+
+// Post-function implementations (no special behavior in this suite)
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
@@ -0,0 +1,131 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/max_tap_count/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestMaxTapCount(SmTdAssertions):
+    """get_smtd_max_tap_count ends a tap sequence with its last meaningful tap,
+    without waiting for SMTD_TIMEOUT_SEQUENCE (100ms)"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def tap(self, key):
+        key.press()
+        smtd.wait(20)
+        key.release()
+
+    def test_last_aggregated_tap_sent_on_release(self):
+        self.tap(K1)
+        smtd.wait(20)
+        self.tap(K1)
+        self.assertHistory(
+            registered(L1_KC2),
+            unregistered(L1_KC2),
+        )
+        smtd.wait(500)
+        self.assertHistory(
+            registered(L1_KC2),
+            unregistered(L1_KC2),
+        )
+
+    def test_shorter_sequence_waits(self):
+        self.tap(K1)
+        smtd.wait(90)
+        self.assertHistory()
+        smtd.wait(20)
+        self.assertHistory(
+            registered(L1_KC1),
+            unregistered(L1_KC1),
+        )
+
+    def test_next_sequence_starts_over(self):
+        self.tap(K1)
+        smtd.wait(20)
+        self.tap(K1)
+        smtd.wait(20)
+        self.tap(K1)
+        smtd.wait(500)
+        self.assertHistory(
+            registered(L1_KC2),
+            unregistered(L1_KC2),
+            registered(L1_KC1),
+            unregistered(L1_KC1),
+        )
+
+    def test_no_limit_waits_for_sequence(self):
+        self.tap(K5)
+        smtd.wait(20)
+        self.tap(K5)
+        self.assertHistory()
+        smtd.wait(500)
+        self.assertHistory(
+            registered(L1_KC5),
+            unregistered(L1_KC5),
+        )
+
+    def test_single_tap_key_holds_after_tap(self):
+        """Tap then hold is a fresh press of K3, so it holds the mod"""
+        self.tap(K3)
+        smtd.wait(20)
+        K3.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K3.release()
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_no_limit_repeats_tap_after_tap(self):
+        """Without the limit, tap then hold is the second tap of K4's sequence"""
+        self.tap(K4)
+        smtd.wait(20)
+        K4.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), 0)
+        K4.release()
+        self.assertHistory(
+            pressed(K4),
+            released(K4),
+            pressed(K4),
+            released(K4),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+L1_KC1 = all_keycodes[10]
+L1_KC2 = all_keycodes[11]
+L1_KC5 = all_keycodes[14]
+
+K1 = Key(smtd, 'K1', 0, 1, "aggregated dance, at most 2 taps", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LSFT), at most 1 tap", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_MT(L0_KC4, KC_LSFT)", all_keycodes)
+K5 = Key(smtd, 'K5', 0, 5, "aggregated dance", all_keycodes)
+
+all_keys = [K1, K2, K3, K4, K5]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
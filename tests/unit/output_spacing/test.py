@@ -0,0 +1,115 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/output_spacing/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+MOD_LALT = 0x04
+MOD_LGUI = 0x08
+
+
+class TestOutputSpacing(SmTdAssertions):
+    """SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS spaces sm_td's own outputs: each
+    one is queued for what is left of the delay since the previous one"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_outputs_keep_their_order_spaced(self):
+        K1.press()
+        smtd.wait(250)
+        K5.press()
+        K5.release()
+        K1.release()
+        smtd.wait(100)
+
+        # the emulated press and release of K5 go out at 270 and 280
+        self.assertEqual(smtd.get_delivered_reports(), [
+            (200, MOD_LSFT),
+            (250, MOD_LSFT | MOD_LGUI),
+            (260, MOD_LSFT),
+            (290, 0),
+        ])
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory(
+            pressed(K5, MOD_LSFT),
+            released(K5, MOD_LSFT),
+        )
+
+    def test_scan_is_not_blocked_while_outputs_wait(self):
+        K1.press()
+        smtd.wait(250)
+        K5.press()
+        K5.release()
+        K1.release()
+        K4.press()
+        K4.release()
+
+        # every event returns right away, the spaced outputs are still queued
+        self.assertEqual(smtd.lib.timer_read32(), 250)
+        self.assertEqual(smtd.get_delivered_reports(), [(200, MOD_LSFT), (250, MOD_LSFT | MOD_LGUI)])
+        self.assertHistory()
+
+        smtd.wait(100)
+        self.assertEqual(smtd.get_delivered_reports(), [
+            (200, MOD_LSFT),
+            (250, MOD_LSFT | MOD_LGUI),
+            (260, MOD_LSFT),
+            (290, 0),
+        ])
+        self.assertHistory(
+            pressed(K5, MOD_LSFT),
+            released(K5, MOD_LSFT),
+            pressed(K4),
+            released(K4),
+        )
+
+    def test_spacing_counts_from_previous_output(self):
+        K1.press()
+        smtd.wait(205)
+        K1.release()
+        smtd.wait(100)
+
+        self.assertEqual(smtd.get_delivered_reports(), [(200, MOD_LSFT), (210, 0)])
+        self.assertHistory()
+
+    def test_single_report_is_not_delayed(self):
+        K1.press()
+        smtd.wait(250)
+        K1.release()
+        smtd.wait(100)
+
+        self.assertEqual(smtd.get_delivered_reports(), [(200, MOD_LSFT), (250, 0)])
+        self.assertHistory()
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LALT)", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+K5 = Key(smtd, 'K5', 0, 5, "SMTD_MTE(L0_KC5, KC_LGUI)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4, K5]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,97 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/output_transaction/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+MOD_LALT = 0x04
+MOD_LGUI = 0x08
+
+
+class TestOutputTransaction(SmTdAssertions):
+    """Reports requested while a cascade resolves are sent once, before the
+    next key sm_td sends or when the cascade ends"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_cascade_of_holds_sends_one_report(self):
+        K1.press()
+        smtd.wait(10)
+        K2.press()
+        smtd.wait(10)
+        K3.press()
+        smtd.wait(10)
+        K4.press()
+        smtd.wait(10)
+        K4.release()
+
+        self.assertEqual(smtd.get_mods(), MOD_LSFT | MOD_LCTL | MOD_LALT)
+        self.assertEqual(smtd.get_report_count(), 1)
+        self.assertHistory(
+            pressed(K4, MOD_LSFT | MOD_LCTL | MOD_LALT),
+            released(K4, MOD_LSFT | MOD_LCTL | MOD_LALT),
+        )
+
+        for key in [K1, K2, K3]:
+            key.release()
+            smtd.wait(10)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertEqual(smtd.get_report_count(), 4)
+
+    def test_single_hold_sends_report_on_timeout(self):
+        K1.press()
+        smtd.wait(250)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        self.assertEqual(smtd.get_report_count(), 1)
+
+        K1.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertEqual(smtd.get_report_count(), 2)
+        self.assertHistory()
+
+    def test_eager_mod_is_reported_before_its_tap(self):
+        K5.press()
+        self.assertEqual(smtd.get_mods(), MOD_LGUI)
+        self.assertEqual(smtd.get_report_count(), 1)
+
+        smtd.wait(10)
+        K5.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertEqual(smtd.get_report_count(), 2)
+        self.assertHistory(
+            pressed(K5),
+            released(K5),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LALT)", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+K5 = Key(smtd, 'K5', 0, 5, "SMTD_MTE(L0_KC5, KC_LGUI)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4, K5]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
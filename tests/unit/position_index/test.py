@@ -0,0 +1,113 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/position_index/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+MOD_LALT = 0x04
+
+
+class TestPositionIndex(SmTdAssertions):
+    """Events on a matrix position go straight to the state that owns it;
+    press order between states is kept by per-state sequence numbers"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def test_following_key_release_makes_hold(self):
+        K2.press()
+        K3.press()
+        K3.release()
+        K2.release()
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LCTL),
+            released(K3, mods=MOD_LCTL),
+        )
+
+    def test_held_state_ignores_other_keys(self):
+        K1.press()
+        smtd.wait(200)
+        K3.press()
+        K3.release()
+        K4.press()
+        K4.release()
+        K1.release()
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LSFT),
+            released(K3, mods=MOD_LSFT),
+            pressed(K4, mods=MOD_LSFT),
+            released(K4, mods=MOD_LSFT),
+        )
+
+    def test_zero_position_key_is_matched_by_keycode(self):
+        K0.press()
+        K3.press()
+        K3.release()
+        K0.release()
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LALT),
+            released(K3, mods=MOD_LALT),
+        )
+
+    def test_order_survives_sequence_renumbering(self):
+        K1.press()
+        smtd.wait(200)
+
+        # every press below opens a new state while K1 stays the oldest one,
+        # so K2 gets the last sequence number and K3 forces a renumbering
+        for _ in range(126):
+            K3.press()
+            K3.release()
+            K4.press()
+            K4.release()
+            smtd.clear_record_history()
+        K3.press()
+        K3.release()
+        smtd.clear_record_history()
+
+        smtd.wait(200)
+        K2.press()
+        K3.press()
+        K3.release()
+        K2.release()
+        K1.release()
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LSFT | MOD_LCTL),
+            released(K3, mods=MOD_LSFT | MOD_LCTL),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K0 = Key(smtd, 'K0', 0, 0, "SMTD_MT(L0_KC0, KC_LALT)", all_keycodes)
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+
+all_keys = [K0, K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
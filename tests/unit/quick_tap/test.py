@@ -0,0 +1,143 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/quick_tap/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class TestQuickTap(SmTdAssertions):
+    """SMTD_GLOBAL_QUICK_TAP holds a key pressed again within its sequence term
+    (100ms), so SMTD_MT and SMTD_LT register their tap key on the press"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def tap(self, key):
+        key.press()
+        smtd.wait(20)
+        key.release()
+
+    def test_tap_then_hold_registers_on_press(self):
+        self.tap(K1)
+        smtd.wait(20)
+        K1.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+        )
+        smtd.wait(500)
+        self.assertEqual(smtd.get_mods(), 0)
+        K1.release()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_double_tap(self):
+        self.tap(K1)
+        smtd.wait(20)
+        self.tap(K1)
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_layer_tap_then_hold(self):
+        self.tap(K3)
+        smtd.wait(20)
+        K3.press()
+        smtd.wait(300)
+        self.assertEqual(smtd.get_layer_state(), 0)
+        K3.release()
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+            pressed(K3),
+            released(K3),
+        )
+
+    def test_other_key_while_held(self):
+        """The repeated key stays down while another key is typed"""
+        self.tap(K1)
+        smtd.wait(20)
+        K1.press()
+        smtd.wait(20)
+        K2.press()
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(20)
+        K1.release()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            pressed(K2),
+            released(K2),
+            released(K1),
+        )
+
+    def test_after_sequence_term_holds_mod(self):
+        self.tap(K1)
+        smtd.wait(110)
+        K1.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        K1.release()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_disabled_per_key(self):
+        self.tap(K4)
+        smtd.wait(20)
+        K4.press()
+        self.assertHistory(
+            pressed(K4),
+            released(K4),
+        )
+        smtd.wait(210)
+        K4.release()
+        self.assertHistory(
+            pressed(K4),
+            released(K4),
+            pressed(K4),
+            released(K4),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_LT(L0_KC3, L1)", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_MT(L0_KC4, KC_LSFT), no quick tap", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
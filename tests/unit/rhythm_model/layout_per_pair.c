@@ -0,0 +1,4 @@
+/* Same layout as layout.c with the release window of the decided pair alone */
+#define SMTD_RHYTHM_MODEL 0
+
+#include "layout.c"
@@ -0,0 +1,145 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd_model = load_smtd_lib('tests/unit/rhythm_model/layout.c')
+smtd_pair = load_smtd_lib('tests/unit/rhythm_model/layout_per_pair.c')
+
+MOD_LSFT = 0x02
+
+
+class CRhythm(ctypes.Structure):
+    _fields_ = [("interval", ctypes.c_uint16), ("overlap", ctypes.c_uint16)]
+
+
+def rhythm():
+    """(interval, overlap) averages of the model in ms"""
+    model = CRhythm.in_dll(smtd_model.lib, 'smtd_rhythm_model')
+    return model.interval / 8, model.overlap / 8
+
+
+def build_keys(smtd):
+    keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+    keys = {name: Key(smtd, name, 0, col, comment, keycodes)
+            for name, col, comment in [('K1', 1, "SMTD_MT(L0_KC1, KC_LSFT)"),
+                                       ('K2', 2, "plain"), ('K3', 3, "plain")]}
+    return keycodes, keys
+
+
+KEYCODES_MODEL, KEYS_MODEL = build_keys(smtd_model)
+KEYCODES_PAIR, KEYS_PAIR = build_keys(smtd_pair)
+
+
+def reset(smtd, keycodes, keys):
+    for keycode in keycodes:
+        keycode.reset()
+    for key in keys.values():
+        key.reset()
+    smtd.reset()
+
+
+def type_steadily(smtd, keys, count):
+    """Plain keys pressed every 100ms and held for 150ms: 50ms overlaps"""
+    smtd.wait(1000)
+    for i in range(count):
+        key = keys['K2'] if i % 2 == 0 else keys['K3']
+        key.press()
+        smtd.wait(50)
+        if i > 0:
+            (keys['K3'] if i % 2 == 0 else keys['K2']).release()
+        smtd.wait(50)
+    smtd.wait(50)
+    (keys['K2'] if count % 2 == 1 else keys['K3']).release()
+    smtd.wait(1000)
+
+
+def quick_chord(smtd, keys):
+    """↓K1 ↓K2 10ms later ↑K1 50ms later ↑K2 5ms later"""
+    K1, K2 = keys['K1'], keys['K2']
+    K1.press()
+    smtd.wait(10)
+    K2.press()
+    smtd.wait(50)
+    K1.release()
+    smtd.wait(5)
+    K2.release()
+    smtd.wait(500)
+
+
+class TestRhythmModel(SmTdAssertions):
+    """SMTD_RHYTHM_MODEL moves p1 and p2 of the decided pair halfway to the
+    averages of the recent typing, so one odd pair moves the window less"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd_model
+
+    def setUp(self):
+        super().setUp()
+        reset(smtd_model, KEYCODES_MODEL, KEYS_MODEL)
+        reset(smtd_pair, KEYCODES_PAIR, KEYS_PAIR)
+
+    def test_averages_follow_typing(self):
+        type_steadily(smtd_model, KEYS_MODEL, 40)
+        interval, overlap = rhythm()
+        self.assertAlmostEqual(interval, 100, delta=2)
+        self.assertAlmostEqual(overlap, 50, delta=2)
+
+    def test_pauses_are_not_typing(self):
+        type_steadily(smtd_model, KEYS_MODEL, 40)
+        before = rhythm()
+        KEYS_MODEL['K2'].press()
+        smtd_model.wait(30)
+        KEYS_MODEL['K2'].release()
+        self.assertEqual(rhythm(), before)
+
+    def test_mod_hold_is_not_an_overlap(self):
+        """↓K1 ↓K2 ↑K2 ↑K1: K1 is released after K2, nothing was rolled over"""
+        type_steadily(smtd_model, KEYS_MODEL, 40)
+        overlap = rhythm()[1]
+        KEYS_MODEL['K1'].press()
+        smtd_model.wait(250)
+        KEYS_MODEL['K2'].press()
+        smtd_model.wait(30)
+        KEYS_MODEL['K2'].release()
+        smtd_model.wait(100)
+        KEYS_MODEL['K1'].release()
+        smtd_model.wait(500)
+        self.assertEqual(rhythm()[1], overlap)
+
+    def test_quick_chord_after_steady_typing(self):
+        """window = min((10 + 88) / 2, (50 + 50) / 2) * 20% = 9ms instead of min(10, 50) * 20% = 2ms"""
+        type_steadily(smtd_model, KEYS_MODEL, 40)
+        smtd_model.clear_record_history()
+        quick_chord(smtd_model, KEYS_MODEL)
+        self.assertHistory(
+            pressed(KEYS_MODEL['K2'], mods=MOD_LSFT),
+            released(KEYS_MODEL['K2'], mods=MOD_LSFT),
+        )
+
+    def test_per_pair_window(self):
+        self.smtd = smtd_pair
+        type_steadily(smtd_pair, KEYS_PAIR, 40)
+        smtd_pair.clear_record_history()
+        quick_chord(smtd_pair, KEYS_PAIR)
+        self.assertHistory(
+            pressed(KEYS_PAIR['K1']),
+            released(KEYS_PAIR['K1']),
+            pressed(KEYS_PAIR['K2']),
+            released(KEYS_PAIR['K2']),
+        )
+
+    def test_untrained_model_uses_pair(self):
+        quick_chord(smtd_model, KEYS_MODEL)
+        self.assertHistory(
+            pressed(KEYS_MODEL['K1']),
+            released(KEYS_MODEL['K1']),
+            pressed(KEYS_MODEL['K2']),
+            released(KEYS_MODEL['K2']),
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -68,6 +68,7 @@ class SmTdAssertions(unittest.TestCase):
         assert self.smtd.get_mods() == 0
         assert self.smtd.get_layer_state() == 0
 
+        self.smtd.flush_timeouts()
         for d in self.smtd.get_deferred_execs():
             if d["active"]: self.smtd.execute_deferred(d["idx"])
         for d in self.smtd.get_deferred_execs():
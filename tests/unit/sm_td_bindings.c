@@ -12,12 +12,13 @@
 #define SMTD_SNPRINT(bffr, bsize, ...) TEST_snprintf(bffr, bsize, __VA_ARGS__);
 
 #define MAKE_KEYPOS(row, col) ((keypos_t){ (row), (col) })
-#define MAKE_KEYEVENT(row, col, pressed) ((keyevent_t){ MAKE_KEYPOS((row), (col)), (pressed) })
+#define MAKE_KEYEVENT(row, col, pressed) ((keyevent_t){ MAKE_KEYPOS((row), (col)), TEST_event_time(), (pressed) })
 #define INVALID_DEFERRED_TOKEN ((deferred_token)0)
 
 #define MOD_BIT(code) (1 << ((code) & 0x07))
 #define LSFT(kc) ((kc) | 0x1000)
 #define KC_LSFT 0xE1
+#define KC_BSPC 0x2A
 #define PROGMEM
 
 /* QMK tap-hold keycode ranges and accessors (mirror quantum_keycodes.h) */
@@ -49,6 +50,7 @@ typedef struct {
 
 typedef struct {
     keypos_t key;
+    uint16_t time;
     bool pressed;
 } keyevent_t;
 
@@ -79,15 +81,34 @@ typedef struct {
     bool active;
 } deferred_exec_info_t;
 
-uint32_t layer_state = 0;
+typedef uint32_t layer_state_t;
+
+layer_state_t layer_state = 0;
 uint8_t current_mods = 0;
 uint8_t weak_mods = 0;
 bool caps_word_active = false;
 static history_t record_history[MAX_RECORD_HISTORY];
 static uint8_t record_count = 0;
+static uint16_t report_count = 0;
+static uint8_t emulated_record_count = 0;
 static deferred_exec_info_t deferred_execs[MAX_DEFERRED_EXECS] = {0};
 static uint8_t deferred_exec_count = 0;
 
+/* Reports reaching the mocked host carry mods only */
+typedef struct {
+    uint8_t mods;
+} report_keyboard_t;
+
+#define MAX_DELIVERED_REPORTS 100
+
+typedef struct {
+    uint32_t time_ms;
+    uint8_t mods;
+} delivered_report_t;
+
+static delivered_report_t delivered_reports[MAX_DELIVERED_REPORTS];
+static uint8_t delivered_report_count = 0;
+
 void TEST_print(const char* format, ...);
 void TEST_snprintf(char* buffer, size_t bsize, const char* format, ...);
 
@@ -100,17 +121,62 @@ void post_process_record(keyrecord_t *record);
  * via TEST_execute_deferred), advanced explicitly with TEST_advance_time */
 static uint32_t mock_time_ms = 0;
 
+/* Simulated main loop latency: key events are stamped mock_event_lag_ms before
+ * they are processed, and deferred execs run mock_exec_lag_ms after their deadline */
+static uint32_t mock_event_lag_ms = 0;
+static uint32_t mock_exec_lag_ms = 0;
+
 uint32_t timer_read32(void) {
     return mock_time_ms;
 }
 
+/* Like QMK's MAKE_KEYEVENT: the 16-bit timer_read() with the lowest bit set */
+uint16_t TEST_event_time(void) {
+    return (uint16_t) (mock_time_ms - mock_event_lag_ms) | 1;
+}
+
+void TEST_set_lag(uint32_t event_ms, uint32_t exec_ms) {
+    mock_event_lag_ms = event_ms;
+    mock_exec_lag_ms = exec_ms;
+}
+
 uint32_t timer_elapsed32(uint32_t last) {
     return mock_time_ms - last;
 }
 
+/* A blocking wait: the main loop doesn't run meanwhile, only time passes */
 void wait_ms(uint16_t ms) {
+    mock_time_ms += ms;
+}
+
+#ifdef SPLIT_KEYBOARD
+/* sm_td runs on the left half, which is connected to USB */
+bool is_keyboard_left(void) {
+    return true;
+}
+#endif
+
+#ifdef EECONFIG_USER_DATA_SIZE
+/* EEPROM user datablock: survives TEST_reset like it survives a reboot */
+static uint8_t mock_user_datablock[EECONFIG_USER_DATA_SIZE] = {0};
+
+void eeconfig_read_user_datablock(void *data, uint32_t offset, uint32_t length) {
+    memcpy(data, mock_user_datablock + offset, length);
+}
+
+void eeconfig_update_user_datablock(const void *data, uint32_t offset, uint32_t length) {
+    memcpy(mock_user_datablock + offset, data, length);
 }
 
+uint8_t TEST_get_user_datablock(uint32_t offset) {
+    return mock_user_datablock[offset];
+}
+
+void TEST_clear_user_datablock(void) {
+    memset(mock_user_datablock, 0, sizeof(mock_user_datablock));
+}
+#endif
+
 uint8_t get_highest_layer(uint32_t state) {
     uint8_t highest = 0;
     for (uint8_t i = 0; i < 32; i++) {
@@ -121,10 +187,16 @@ uint8_t get_highest_layer(uint32_t state) {
     return highest;
 }
 
+/* Layouts that remap keys at runtime (like a VIA / Vial dynamic keymap) define
+ * SMTD_LAYOUT_DEFINES_KEYMAP_LOOKUP and provide their own keymap_key_to_keycode */
+uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key);
+
+#ifndef SMTD_LAYOUT_DEFINES_KEYMAP_LOOKUP
 uint16_t keymap_key_to_keycode(uint8_t layer, keypos_t key) {
     extern uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS];
     return keymaps[layer][key.row][key.col];
 }
+#endif
 
 /* QMK runs every layer_state mutation through layer_state_set (and its _kb/_user
  * hooks), where features like tri-layer and layer lock adjust the resulting mask.
@@ -162,6 +234,10 @@ void add_weak_mods(uint8_t mods) {
     weak_mods |= mods;
 }
 
+void set_weak_mods(uint8_t mods) {
+    weak_mods = mods;
+}
+
 void del_weak_mods(uint8_t mods) {
     weak_mods &= ~mods;
 }
@@ -218,9 +294,12 @@ uint8_t get_mods(void) {
     return current_mods;
 }
 
+void send_keyboard_report(void);
+
 void register_mods(uint8_t mods) {
     TEST_print("             --> Register mods: %d\n", mods);
     current_mods |= mods;
+    send_keyboard_report();
 }
 
 void add_mods(uint8_t mods) {
@@ -231,6 +310,7 @@ void add_mods(uint8_t mods) {
 void unregister_mods(uint8_t mods) {
     TEST_print("             --> Unregister mods: %d\n", mods);
     current_mods &= ~mods;
+    send_keyboard_report();
 }
 
 void del_mods(uint8_t mods) {
@@ -238,11 +318,24 @@ void del_mods(uint8_t mods) {
     current_mods &= ~mods;
 }
 
+static void TEST_deliver_report(report_keyboard_t *report) {
+    TEST_print("             --> Deliver report: mods %d\n", report->mods);
+    delivered_reports[delivered_report_count++] = (delivered_report_t) {
+        .time_ms = mock_time_ms,
+        .mods = report->mods,
+    };
+}
+
 void send_keyboard_report(void) {
-    // No-op in mock
+    // Like QMK's register_mods / unregister_mods, which send it too
+    TEST_print("             --> Send report\n");
+    report_count++;
+    report_keyboard_t report = {.mods = current_mods | weak_mods};
+    TEST_deliver_report(&report);
 }
 
 bool get_smtd_bypass();
+bool smtd_is_emulating(void);
 
 void unregister_code16(uint16_t keycode) {
     TEST_print("             --> Unregister code: %d\n", keycode);
@@ -281,6 +374,11 @@ void tap_code16(uint16_t keycode) {
     unregister_code16(keycode);
 }
 
+/* Characters are sent as keycodes of the same value */
+void send_char(char ascii_code) {
+    tap_code16((uint8_t) ascii_code);
+}
+
 bool process_record(keyrecord_t *record) {
     /* Mirrors the part of QMK's pipeline relevant for sm_td tests:
      * Caps Word sees every emulated event before the key action is taken */
@@ -297,6 +395,7 @@ bool process_record(keyrecord_t *record) {
         .smtd_bypass = get_smtd_bypass(),
     };
     record_count++;
+    if (smtd_is_emulating()) emulated_record_count++;
 
     post_process_record(record);
 
@@ -319,12 +418,39 @@ void cancel_deferred_exec(deferred_token token) {
     }
 }
 
+bool extend_deferred_exec(deferred_token token, uint32_t delay_ms) {
+    if (token == 0 || token > deferred_exec_count || !deferred_execs[token-1].active) {
+        return false;
+    }
+    deferred_execs[token-1].delay_ms = delay_ms;
+    deferred_execs[token-1].deadline_ms = mock_time_ms + delay_ms;
+    return true;
+}
+
+/* Mirrors QMK's deferred_exec_advanced_task: a non-zero return value re-arms the
+ * exec relative to its previous trigger time, zero frees it */
+static void TEST_run_deferred(uint8_t i, uint32_t trigger_time) {
+    uint32_t delay_ms = 0;
+    if (deferred_execs[i].callback != NULL) {
+        delay_ms = deferred_execs[i].callback(trigger_time, deferred_execs[i].cb_arg);
+    }
+    if (!deferred_execs[i].active) return; // cancelled by the callback itself
+    if (delay_ms > 0) {
+        deferred_execs[i].delay_ms = delay_ms;
+        deferred_execs[i].deadline_ms = trigger_time + delay_ms;
+    } else {
+        deferred_execs[i].active = false;
+    }
+}
+
 
 void TEST_print(const char* format, ...) {
+#ifndef TEST_QUIET
     va_list args;
     va_start(args, format);
     vprintf(format, args);
     va_end(args);
+#endif
 }
 
 void TEST_snprintf(char* buffer, size_t bsize, const char* format, ...) {
@@ -362,18 +488,15 @@ void TEST_advance_time(uint32_t ms) {
         int next = -1;
         for (uint8_t i = 0; i < deferred_exec_count; i++) {
             if (!deferred_execs[i].active) continue;
-            if (deferred_execs[i].deadline_ms > target) continue;
+            if (deferred_execs[i].deadline_ms + mock_exec_lag_ms > target) continue;
             if (next == -1 || deferred_execs[i].deadline_ms < deferred_execs[next].deadline_ms) {
                 next = i;
             }
         }
         if (next == -1) break;
 
-        mock_time_ms = deferred_execs[next].deadline_ms;
-        deferred_execs[next].active = false;
-        if (deferred_execs[next].callback != NULL) {
-            deferred_execs[next].callback(mock_time_ms, deferred_execs[next].cb_arg);
-        }
+        mock_time_ms = deferred_execs[next].deadline_ms + mock_exec_lag_ms;
+        TEST_run_deferred(next, deferred_execs[next].deadline_ms);
     }
 
     mock_time_ms = target;
@@ -381,11 +504,16 @@ void TEST_advance_time(uint32_t ms) {
 
 void TEST_reset() {
     mock_time_ms = 0;
+    mock_event_lag_ms = 0;
+    mock_exec_lag_ms = 0;
     layer_state = 0;
     current_mods = 0;
     weak_mods = 0;
     caps_word_active = false;
     record_count = 0;
+    report_count = 0;
+    emulated_record_count = 0;
+    delivered_report_count = 0;
     deferred_exec_count = 0;
     smtd_executing_state = NULL;
     for (uint8_t i = 0; i < MAX_RECORD_HISTORY; i++) {
@@ -395,11 +523,59 @@ void TEST_reset() {
         deferred_execs[i] = (deferred_exec_info_t){0};
     }
     for (uint8_t i = 0; i < SMTD_POOL_SIZE; i++) {
-        smtd_active_states[i] = NULL;
         reset_state(&smtd_states_pool[i]);
     }
+    smtd_free_slots_reset();
+    memset(smtd_position_index, 0, sizeof(smtd_position_index));
+    smtd_active_head = NULL;
+    smtd_active_tail = NULL;
     smtd_active_states_size = 0;
+    smtd_active_seq = 0;
+    smtd_undetermined_head = NULL;
+    smtd_timeout_head = NULL;
+    smtd_timeout_head_valid = true;
     smtd_bypass = false;
+    smtd_emulating = false;
+    smtd_timer_token = INVALID_DEFERRED_TOKEN;
+    smtd_timer_dispatching = false;
+    smtd_clock = 0;
+    smtd_wall_clock = 0;
+    smtd_fired_at = 0;
+    smtd_speculative = (smtd_speculative_stats){0};
+    smtd_flow_streak = false;
+    smtd_flow_tap_at = 0;
+#if SMTD_RHYTHM_MODEL
+    smtd_rhythm_model = (smtd_rhythm){0};
+#endif
+#if SMTD_UNMANAGED_KEYS
+    smtd_unmanaged_passed = false;
+#endif
+#if SMTD_LEARN_UNHANDLED
+    memset(smtd_unhandled_keycodes, 0, sizeof(smtd_unhandled_keycodes));
+#endif
+    smtd_output_depth = 0;
+    smtd_report_pending = false;
+#if SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS > 0
+    smtd_output_sent_at = -(uint32_t) SMTD_GLOBAL_SIMULTANEOUS_PRESSES_DELAY_MS;
+#endif
+#if SMTD_OUTPUT_QUEUE
+    smtd_stream_head = 0;
+    smtd_stream_size = 0;
+#if SMTD_MACRO_STREAM
+    smtd_stream_chars_head = 0;
+    smtd_stream_chars_size = 0;
+#endif
+    smtd_stream_emitting = false;
+    smtd_stream_token = INVALID_DEFERRED_TOKEN;
+    smtd_held_events_size = 0;
+    smtd_held_replaying = false;
+#endif
+#if SMTD_ADAPTIVE_TERMS
+    memset(smtd_adaptive_terms, 0, sizeof(smtd_adaptive_terms));
+    smtd_adaptive_loaded = false;
+    smtd_adaptive_pending = (smtd_adaptive_sample){0};
+    smtd_adaptive_save_token = INVALID_DEFERRED_TOKEN;
+#endif
 }
 
 bool get_smtd_bypass() {
@@ -410,6 +586,26 @@ void TEST_set_smtd_bypass(const bool bypass) {
     smtd_bypass = bypass;
 }
 
+uint16_t TEST_get_report_count() {
+    return report_count;
+}
+
+uint8_t TEST_get_emulated_record_count() {
+    return emulated_record_count;
+}
+
+uint8_t TEST_get_delivered_report_count() {
+    return delivered_report_count;
+}
+
+uint32_t TEST_get_delivered_report_time(uint8_t i) {
+    return delivered_reports[i].time_ms;
+}
+
+uint8_t TEST_get_delivered_report_mods(uint8_t i) {
+    return delivered_reports[i].mods;
+}
+
 uint8_t TEST_get_layer_state() {
     return get_highest_layer(layer_state);
 }
@@ -427,6 +623,13 @@ uint8_t TEST_get_weak_mods() {
     return weak_mods;
 }
 
+void TEST_clear_record_history() {
+    record_count = 0;
+    for (uint8_t i = 0; i < MAX_RECORD_HISTORY; i++) {
+        record_history[i] = (history_t){0};
+    }
+}
+
 void TEST_get_record_history(history_t *out_records, uint8_t *out_count) {
     *out_count = record_count;
     for (uint8_t i = 0; i < record_count; i++) {
@@ -443,11 +646,39 @@ void TEST_get_deferred_execs(deferred_exec_info_t *out_execs, uint8_t *out_count
 
 void TEST_execute_deferred(deferred_token token) {
     if (token > 0 && token <= deferred_exec_count && deferred_execs[token-1].active) {
-        deferred_exec_callback callback = deferred_execs[token-1].callback;
-        void *cb_arg = deferred_execs[token-1].cb_arg;
-        if (callback != NULL) {
-            callback(0, cb_arg);
+        TEST_run_deferred(token-1, deferred_execs[token-1].deadline_ms);
+    }
+}
+
+/* State timeouts share one deferred exec, so tests address a timeout by the
+ * position of the key that owns it instead of by a deferred token */
+static smtd_state *TEST_find_state(uint8_t row, uint8_t col) {
+    for (smtd_state *state = smtd_active_head; state != NULL; state = smtd_next(state)) {
+        if (state->pressed_keyposition.row == row && state->pressed_keyposition.col == col) {
+            return state;
         }
-        deferred_execs[token-1].active = false;
+    }
+    return NULL;
+}
+
+bool TEST_has_timeout(uint8_t row, uint8_t col) {
+    smtd_state *state = TEST_find_state(row, col);
+    return state != NULL && state->timeout_pending;
+}
+
+/* Fires the pending timeout of the key at (row, col) right away, regardless of
+ * the virtual clock. Returns false when that key has no pending timeout. */
+bool TEST_fire_timeout(uint8_t row, uint8_t col) {
+    smtd_state *state = TEST_find_state(row, col);
+    if (state == NULL || !state->timeout_pending) return false;
+    smtd_fire_timeout(state);
+    return true;
+}
+
+/* Fires every pending state timeout in deadline order, regardless of the clock */
+void TEST_flush_timeouts(void) {
+    smtd_state *state;
+    while ((state = smtd_earliest_timeout()) != NULL) {
+        smtd_fire_timeout(state);
     }
 }
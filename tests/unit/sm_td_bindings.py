@@ -18,6 +18,7 @@ class CKeyPosition(ctypes.Structure):
 class CKeyEvent(ctypes.Structure):
     _fields_ = [
         ("key", CKeyPosition),
+        ("time", ctypes.c_uint16),
         ("pressed", ctypes.c_bool)
     ]
 
@@ -27,11 +28,12 @@ class CKeyRecord(ctypes.Structure):
         ("event", CKeyEvent)
     ]
 
-def create_ckeyrecord(row: int, col: int, pressed: bool) -> CKeyRecord:
+def create_ckeyrecord(row: int, col: int, pressed: bool, time: int) -> CKeyRecord:
     """Helper to create a keyrecord structure"""
     record = CKeyRecord()
     record.event.key.row = row
     record.event.key.col = col
+    record.event.time = time
     record.event.pressed = pressed
     return record
 
@@ -66,36 +68,36 @@ class Keycode:
         self.col = col
         self.layer = layer
         self.pressed = False
-        self.defer_idx = None
+        self.has_timeout = False
 
     def reset(self):
         self.pressed = False
-        self.defer_idx = None
+        self.has_timeout = False
 
     def press(self):
         assert self.pressed == False
         assert self.smtd.get_layer_state() == self.layer
         self.pressed = True
-        result, defer_idx = self.smtd.process_key_and_timeout(self, True)
-        self.defer_idx = defer_idx
+        result, has_timeout = self.smtd.process_key_and_timeout(self, True)
+        self.has_timeout = has_timeout
         return result
 
     def release(self):
         assert self.pressed == True
         self.pressed = False
-        result, defer_idx = self.smtd.process_key_and_timeout(self, False)
-        self.defer_idx = defer_idx
+        result, has_timeout = self.smtd.process_key_and_timeout(self, False)
+        self.has_timeout = has_timeout
         return result
 
     def prolong(self):
-        assert self.defer_idx is not None
-        self.smtd.execute_deferred(self.defer_idx)
-        self.defer_idx = None
+        assert self.has_timeout
+        assert self.smtd.fire_timeout(self)
+        self.has_timeout = False
 
     def try_prolong(self):
-        if self.defer_idx is None: return
-        self.smtd.execute_deferred(self.defer_idx, False)
-        self.defer_idx = None
+        if not self.has_timeout: return
+        self.smtd.fire_timeout(self)
+        self.has_timeout = False
 
     def __str__(self):
         return self.value
@@ -164,15 +166,22 @@ class SmtdBindings:
     def __init__(self, lib: ctypes.CDLL):
         self.lib = lib
 
-    def process_key_and_timeout(self, keycode: Keycode, pressed: bool) -> Tuple[bool, Optional[int]]:
-        execs_before = self.get_deferred_execs()
-        record_ptr = ctypes.pointer(create_ckeyrecord(keycode.row, keycode.col, pressed))
+    def process_key_and_timeout(self, keycode: Keycode, pressed: bool) -> Tuple[bool, bool]:
+        record_ptr = ctypes.pointer(create_ckeyrecord(keycode.row, keycode.col, pressed, self.lib.TEST_event_time()))
         result = self.lib.process_smtd(ctypes.c_uint(keycode.value), record_ptr)
-        execs_after = self.get_deferred_execs()
-        execs_diff = execs_after[len(execs_before):]
-        if len(execs_diff) == 0:
-            return result, None
-        return result, execs_diff[-1]["idx"]
+        return result, self.has_timeout(keycode)
+
+    def has_timeout(self, keycode: Keycode) -> bool:
+        """Whether the state of the key at the keycode's position has a pending timeout"""
+        return self.lib.TEST_has_timeout(ctypes.c_uint8(keycode.row), ctypes.c_uint8(keycode.col))
+
+    def fire_timeout(self, keycode: Keycode) -> bool:
+        """Fire the pending timeout of the key at the keycode's position, regardless of the clock"""
+        return self.lib.TEST_fire_timeout(ctypes.c_uint8(keycode.row), ctypes.c_uint8(keycode.col))
+
+    def flush_timeouts(self) -> None:
+        """Fire every pending state timeout in deadline order, regardless of the clock"""
+        self.lib.TEST_flush_timeouts()
 
     def set_bypass(self, enabled: bool) -> None:
         """Set the smtd_bypass flag"""
@@ -201,6 +210,10 @@ class SmtdBindings:
             })
         return result
 
+    def clear_record_history(self) -> None:
+        """Forget the key records processed so far (for scenarios longer than the history)"""
+        self.lib.TEST_clear_record_history()
+
     def get_deferred_execs(self) -> List[Dict[str, Any]]:
         """Get the list of deferred executions scheduled in the test environment"""
         execs_array = (CDeferredExecInfo * 100)()  # MAX_DEFERRED_EXECS is 100
@@ -230,6 +243,10 @@ class SmtdBindings:
         """Advance the virtual clock, firing deferred executions that come due"""
         self.lib.TEST_advance_time(ctypes.c_uint32(ms))
 
+    def set_lag(self, event_ms: int, exec_ms: int) -> None:
+        """Stamp key events event_ms before they are processed and run deferred executions exec_ms late"""
+        self.lib.TEST_set_lag(ctypes.c_uint32(event_ms), ctypes.c_uint32(exec_ms))
+
     def get_mods(self) -> int:
         """Get the current modifier state"""
         return self.lib.get_mods()
@@ -238,6 +255,20 @@ class SmtdBindings:
         """Get the current layer state"""
         return self.lib.TEST_get_layer_state()
 
+    def get_report_count(self) -> int:
+        """Get the number of keyboard reports sent so far"""
+        return self.lib.TEST_get_report_count()
+
+    def get_emulated_record_count(self) -> int:
+        """Get the number of records replayed with smtd_is_emulating() set"""
+        return self.lib.TEST_get_emulated_record_count()
+
+    def get_delivered_reports(self) -> List[Tuple[int, int]]:
+        """Get (time, mods) of every report that reached the mocked host"""
+        count = self.lib.TEST_get_delivered_report_count()
+        return [(self.lib.TEST_get_delivered_report_time(i), self.lib.TEST_get_delivered_report_mods(i))
+                for i in range(count)]
+
     def set_caps_word(self, on: bool) -> None:
         """Turn the mocked Caps Word state on or off"""
         self.lib.TEST_set_caps_word(ctypes.c_bool(on))
@@ -304,6 +335,9 @@ def load_smtd_lib(path: str) -> SmtdBindings:
     ]
     lib.TEST_get_record_history.restype = None
 
+    lib.TEST_clear_record_history.argtypes = []
+    lib.TEST_clear_record_history.restype = None
+
     lib.TEST_get_deferred_execs.argtypes = [
         ctypes.POINTER(CDeferredExecInfo),  # out_execs
         ctypes.POINTER(ctypes.c_uint8)  # out_count
@@ -313,8 +347,21 @@ def load_smtd_lib(path: str) -> SmtdBindings:
     lib.TEST_execute_deferred.argtypes = [ctypes.c_uint8]  # deferred_token
     lib.TEST_execute_deferred.restype = None
 
+    lib.TEST_has_timeout.argtypes = [ctypes.c_uint8, ctypes.c_uint8]
+    lib.TEST_has_timeout.restype = ctypes.c_bool
+
+    lib.TEST_fire_timeout.argtypes = [ctypes.c_uint8, ctypes.c_uint8]
+    lib.TEST_fire_timeout.restype = ctypes.c_bool
+
+    lib.TEST_flush_timeouts.argtypes = []
+    lib.TEST_flush_timeouts.restype = None
+
     lib.TEST_advance_time.argtypes = [ctypes.c_uint32]
     lib.TEST_advance_time.restype = None
+    lib.TEST_event_time.argtypes = []
+    lib.TEST_event_time.restype = ctypes.c_uint16
+    lib.TEST_set_lag.argtypes = [ctypes.c_uint32, ctypes.c_uint32]
+    lib.TEST_set_lag.restype = None
 
     lib.get_mods.argtypes = []  # No arguments
     lib.get_mods.restype = ctypes.c_uint8  # Returns uint8_t
@@ -322,6 +369,18 @@ def load_smtd_lib(path: str) -> SmtdBindings:
     lib.TEST_get_layer_state.argtypes = []
     lib.TEST_get_layer_state.restype = ctypes.c_uint8
 
+    lib.TEST_get_report_count.argtypes = []
+    lib.TEST_get_report_count.restype = ctypes.c_uint16
+
+    lib.TEST_get_delivered_report_count.argtypes = []
+    lib.TEST_get_delivered_report_count.restype = ctypes.c_uint8
+
+    lib.TEST_get_delivered_report_time.argtypes = [ctypes.c_uint8]
+    lib.TEST_get_delivered_report_time.restype = ctypes.c_uint32
+
+    lib.TEST_get_delivered_report_mods.argtypes = [ctypes.c_uint8]
+    lib.TEST_get_delivered_report_mods.restype = ctypes.c_uint8
+
     lib.TEST_set_caps_word.argtypes = [ctypes.c_bool]
     lib.TEST_set_caps_word.restype = None
 
@@ -0,0 +1,181 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/speculative_taps/layout.c')
+
+MOD_LSFT = 0x02
+
+
+class CSpeculativeStats(ctypes.Structure):
+    _fields_ = [("taps", ctypes.c_uint16), ("rollbacks", ctypes.c_uint16)]
+
+
+smtd.lib.smtd_get_speculative_stats.argtypes = []
+smtd.lib.smtd_get_speculative_stats.restype = CSpeculativeStats
+
+
+class TestSpeculativeTaps(SmTdAssertions):
+    """SMTD_GLOBAL_SPECULATIVE_TAPS sends the tap on the press and takes it back
+    with SMTD_SPECULATIVE_CORRECTION once the key resolves as a hold"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def assertStats(self, taps, rollbacks):
+        stats = smtd.lib.smtd_get_speculative_stats()
+        self.assertEqual((stats.taps, stats.rollbacks), (taps, rollbacks))
+
+    def test_tap_sent_on_press(self):
+        K1.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        smtd.wait(100)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        self.assertStats(1, 0)
+
+    def test_hold_by_timeout_rolls_back(self):
+        K1.press()
+        smtd.wait(210)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(BSPC),
+            unregistered(BSPC),
+        )
+        K1.release()
+        self.assertStats(1, 1)
+
+    def test_hold_by_following_release_rolls_back(self):
+        K1.press()
+        smtd.wait(20)
+        K2.press()
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(20)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(BSPC),
+            unregistered(BSPC),
+            pressed(K2, mods=MOD_LSFT),
+            released(K2, mods=MOD_LSFT),
+        )
+        self.assertStats(1, 1)
+
+    def test_roll_keeps_speculative_tap(self):
+        """↓K1 ↓K2 ↑K1 ↑K2 after the release window: both are taps"""
+        K1.press()
+        smtd.wait(40)
+        K2.press()
+        smtd.wait(80)
+        K1.release()
+        smtd.wait(20)
+        K2.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K2),
+            released(K2),
+        )
+        self.assertStats(1, 0)
+
+    def test_following_key_is_not_speculated(self):
+        """A key pressed under an undecided one can't overtake it"""
+        K1.press()
+        smtd.wait(20)
+        K4.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        smtd.wait(20)
+        K4.release()
+        smtd.wait(20)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            registered(BSPC),
+            unregistered(BSPC),
+            pressed(K4, mods=MOD_LSFT),
+            released(K4, mods=MOD_LSFT),
+        )
+        self.assertStats(1, 1)
+
+    def test_second_tap_of_sequence_waits(self):
+        K1.press()
+        smtd.wait(20)
+        K1.release()
+        smtd.wait(20)
+        K1.press()
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        smtd.wait(20)
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K1),
+            released(K1),
+        )
+        self.assertStats(1, 0)
+
+    def test_disabled_per_key(self):
+        K3.press()
+        self.assertHistory()
+        smtd.wait(20)
+        K3.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K3),
+            released(K3),
+        )
+        self.assertStats(0, 0)
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(8)] + \
+               [Keycode(smtd, 0x2A, 0, 8, 0)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+BSPC = all_keycodes[8]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "plain", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MTE(L0_KC3, KC_LSFT), not speculative", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "SMTD_MT(L0_KC4, KC_LSFT)", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
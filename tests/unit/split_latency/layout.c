@@ -0,0 +1,74 @@
+/* Layout configuration for sm_td tests: split transport latency compensation.
+ * Rows 0-1 are the left half (running sm_td), rows 2-3 the right half. */
+#define SMTD_UNIT_TEST
+
+#define MATRIX_ROWS 4
+#define MATRIX_COLS 9
+
+#define TAPPING_TERM 200
+#define SMTD_GLOBAL_RELEASE_PERCENT 20
+
+#define SPLIT_KEYBOARD
+#ifndef SMTD_SPLIT_LATENCY_MS
+#define SMTD_SPLIT_LATENCY_MS 8
+#endif
+
+#include "../sm_td_bindings.c"
+
+#define KC_LCTL 0xE0
+
+enum LAYERS { L0 = 0, L1 = 1 };
+
+enum KEYCODES {
+    L0_KC0 = 100, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8,//
+    L0_KR0 = 120, L0_KR1, L0_KR2, L0_KR3, L0_KR4, L0_KR5, L0_KR6, L0_KR7, L0_KR8,//
+    L1_KC0 = 200, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8,//
+    L1_KR0 = 220, L1_KR1, L1_KR2, L1_KR3, L1_KR4, L1_KR5, L1_KR6, L1_KR7, L1_KR8,//
+};
+
+uint16_t const keymaps[][MATRIX_ROWS][MATRIX_COLS] = {
+    [L0] = {
+        { L0_KC0, L0_KC1, L0_KC2, L0_KC3, L0_KC4, L0_KC5, L0_KC6, L0_KC7, L0_KC8, },
+        { 0 },
+        { L0_KR0, L0_KR1, L0_KR2, L0_KR3, L0_KR4, L0_KR5, L0_KR6, L0_KR7, L0_KR8, },
+        { 0 },
+    },
+    [L1] = {
+        { L1_KC0, L1_KC1, L1_KC2, L1_KC3, L1_KC4, L1_KC5, L1_KC6, L1_KC7, L1_KC8, },
+        { 0 },
+        { L1_KR0, L1_KR1, L1_KR2, L1_KR3, L1_KR4, L1_KR5, L1_KR6, L1_KR7, L1_KR8, },
+        { 0 },
+    },
+};
+
+smtd_resolution on_smtd_action(uint16_t keycode, smtd_action action, uint8_t tap_count) {
+    switch (keycode) {
+        SMTD_MT(L0_KC1, KC_LSFT)
+        SMTD_MT(L0_KR3, KC_LCTL)
+    }
+    return SMTD_RESOLUTION_UNHANDLED;
+}
+
+uint32_t get_smtd_timeout(uint16_t keycode, smtd_timeout timeout) {
+    return get_smtd_timeout_default(timeout);
+}
+
+bool smtd_feature_enabled(uint16_t keycode, smtd_feature feature) {
+    return smtd_feature_enabled_default(keycode, feature);
+}
+
+char* smtd_keycode_to_str_user(uint16_t keycode) {
+    static char buffer[16];
+    TEST_snprintf(buffer, sizeof(buffer), "KC_%d", keycode);
+    return buffer;
+}
+
+// Post-function implementations (no special behavior in this suite)
+void post_register_code16(uint16_t keycode) {
+}
+
+void post_unregister_code16(uint16_t keycode) {
+}
+
+void post_process_record(keyrecord_t *record) {
+}
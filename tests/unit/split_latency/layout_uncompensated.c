@@ -0,0 +1,4 @@
+/* Same layout as layout.c without split latency compensation */
+#define SMTD_SPLIT_LATENCY_MS 0
+
+#include "layout.c"
@@ -0,0 +1,117 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd_comp = load_smtd_lib('tests/unit/split_latency/layout.c')
+smtd_raw = load_smtd_lib('tests/unit/split_latency/layout_uncompensated.c')
+
+TRANSPORT_DELAY = 8  # SMTD_SPLIT_LATENCY_MS in layout.c
+
+MOD_LSFT = 0x02
+
+
+def build_keys(smtd):
+    """Row 0 is the left half (running sm_td), row 2 the right half.
+    K1 is SMTD_MT(L0_KC1, KC_LSFT), R3 is SMTD_MT(L0_KR3, KC_LCTL)."""
+    keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 120 + col, 2, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)] + \
+               [Keycode(smtd, 220 + col, 2, col, 1) for col in range(9)]
+    keys = {name: Key(smtd, name, row, col, "", keycodes)
+            for name, row, col in [('K1', 0, 1), ('K2', 0, 2), ('R2', 2, 2), ('R3', 2, 3)]}
+    return keycodes, keys
+
+
+KEYCODES_COMP, KEYS_COMP = build_keys(smtd_comp)
+KEYCODES_RAW, KEYS_RAW = build_keys(smtd_raw)
+
+
+def reset(smtd, keycodes, keys):
+    for keycode in keycodes:
+        keycode.reset()
+    for key in keys.values():
+        key.reset()
+    smtd.reset()
+
+
+def arrivals(keys, trace, transport_delay):
+    """Events of the right half reach sm_td transport_delay later"""
+    return sorted(((time + (transport_delay if keys[name].row >= 2 else 0), name, press)
+                   for time, name, press in trace), key=lambda event: event[0])
+
+
+def run_trace(smtd, keycodes, keys, trace, transport_delay):
+    """Replays (time, key name, pressed) events, QMK stamps them on arrival"""
+    reset(smtd, keycodes, keys)
+    smtd.wait(1000)
+    now = 0
+    for time, name, press in arrivals(keys, trace, transport_delay):
+        smtd.wait(time - now)
+        now = time
+        if press:
+            keys[name].press()
+        else:
+            keys[name].release()
+    smtd.wait(1000)
+    return smtd.get_record_history()
+
+
+def overlap_traces():
+    """↓mod ↓key ↑mod ↑key across the halves, around the dynamic release window"""
+    for mod, key in [('K1', 'R2'), ('R3', 'K2')]:
+        for press_at in (40, 60, 80):
+            for release_gap in range(1, 16):
+                yield [(0, mod, True), (press_at, key, True), (100, mod, False), (100 + release_gap, key, False)]
+
+
+class TestSplitLatency(SmTdAssertions):
+    """SMTD_SPLIT_LATENCY_MS moves the right half's events back to the time of the
+    press, so decisions match the ones made without any transport delay"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd_comp
+
+    def setUp(self):
+        super().setUp()
+        reset(smtd_comp, KEYCODES_COMP, KEYS_COMP)
+        reset(smtd_raw, KEYCODES_RAW, KEYS_RAW)
+
+    def accuracy(self, smtd, keycodes, keys):
+        """Only counts traces the transport doesn't reorder: timestamps can be
+        corrected, but a local event processed before an earlier one of the other
+        half is still on its way can't be taken back"""
+        traces = [trace for trace in overlap_traces()
+                  if [e[1:] for e in arrivals(keys, trace, TRANSPORT_DELAY)] == [e[1:] for e in trace]]
+        correct = 0
+        for trace in traces:
+            expected = run_trace(smtd_raw, KEYCODES_RAW, KEYS_RAW, trace, 0)
+            if run_trace(smtd, keycodes, keys, trace, TRANSPORT_DELAY) == expected:
+                correct += 1
+        print(f"\n{correct}/{len(traces)} decisions match the ones without transport delay")
+        return correct, len(traces)
+
+    def test_compensated_decisions_match(self):
+        correct, total = self.accuracy(smtd_comp, KEYCODES_COMP, KEYS_COMP)
+        self.assertEqual(correct, total)
+
+    def test_uncompensated_decisions_drift(self):
+        self.smtd = smtd_raw
+        correct, total = self.accuracy(smtd_raw, KEYCODES_RAW, KEYS_RAW)
+        self.assertLess(correct, total)
+
+    def test_hold_waits_for_transport(self):
+        """A right half press stamped before the tap term may still be on its way"""
+        K1 = KEYS_COMP['K1']
+        K1.press()
+        smtd_comp.wait(200)
+        self.assertEqual(smtd_comp.get_mods(), 0)
+        smtd_comp.wait(TRANSPORT_DELAY)
+        self.assertEqual(smtd_comp.get_mods(), MOD_LSFT)
+        K1.release()
+        self.assertHistory()
+
+
+if __name__ == "__main__":
+    unittest.main()
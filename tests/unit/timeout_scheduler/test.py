@@ -0,0 +1,116 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/timeout_scheduler/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+MOD_LALT = 0x04
+
+
+class TestTimeoutScheduler(SmTdAssertions):
+    """Every pending state keeps its own deadline, while sm_td itself holds
+    at most one deferred exec armed for the earliest of them"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def active_execs(self):
+        return [d for d in smtd.get_deferred_execs() if d["active"]]
+
+    def test_pending_states_share_one_exec(self):
+        K1.press()
+        smtd.wait(10)
+        K2.press()
+        smtd.wait(10)
+        K3.press()
+        smtd.wait(10)
+        K4.press()
+
+        self.assertEqual(len(self.active_execs()), 1)
+        self.assertEqual(self.active_execs()[0]["deadline_ms"], 200, "armed for the first deadline")
+
+        K4.release()
+        K3.release()
+        K2.release()
+        K1.release()
+        smtd.wait(500)
+        self.assertEqual(len(self.active_execs()), 0, "slot is freed once nothing is pending")
+
+    def test_timeouts_fire_in_deadline_order(self):
+        K1.press()
+        smtd.wait(50)
+        K2.press()
+
+        smtd.wait(150)  # K1 tap term
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+
+        smtd.wait(49)
+        self.assertEqual(smtd.get_mods(), MOD_LSFT)
+
+        smtd.wait(1)  # K2 tap term
+        self.assertEqual(smtd.get_mods(), MOD_LSFT | MOD_LCTL)
+
+        K2.release()
+        K1.release()
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory()
+
+    def test_earlier_deadline_rearms_exec(self):
+        K1.press()
+        smtd.wait(10)
+        K2.press()
+        K2.release()  # K2 enters its sequence stage, due in TAPPING_TERM / 2
+
+        self.assertEqual(len(self.active_execs()), 1)
+        self.assertEqual(self.active_execs()[0]["deadline_ms"], 110)
+
+        K1.release()
+        smtd.wait(500)
+        self.assertHistory(
+            pressed(K2, mods=MOD_LSFT),
+            released(K2, mods=MOD_LSFT),
+        )
+
+    def test_cancelled_deadline_does_not_fire(self):
+        K1.press()
+        smtd.wait(100)
+        K1.release()  # tap: the touch deadline at 200 is dropped
+
+        smtd.wait(150)
+        self.assertEqual(smtd.get_mods(), 0)
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+        self.assertEqual(len(self.active_execs()), 0)
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "SMTD_MT(L0_KC3, KC_LALT)", all_keycodes)
+K4 = Key(smtd, 'K4', 0, 4, "plain", all_keycodes)
+
+all_keys = [K1, K2, K3, K4]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+
+
+if __name__ == "__main__":
+    unittest.main()
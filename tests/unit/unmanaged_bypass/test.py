@@ -0,0 +1,131 @@
+try:
+    from tests.unit.sm_td_assertions import *
+except ImportError:
+    from sm_td_assertions import *
+
+smtd = load_smtd_lib('tests/unit/unmanaged_bypass/layout.c')
+
+MOD_LCTL = 0x01
+MOD_LSFT = 0x02
+
+
+class TestUnmanagedBypass(SmTdAssertions):
+    """With SMTD_BYPASS_UNMANAGED, keys outside smtd_managed_layout are left to
+    QMK while nothing is pending, and are queued without reaching
+    on_smtd_action while an sm_td key is pending"""
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.smtd = smtd
+
+    def setUp(self):
+        super().setUp()
+        reset()
+
+    def assertNoUnmanagedActions(self):
+        self.assertEqual(smtd.lib.TEST_get_unmanaged_actions(), 0, "on_smtd_action saw an unmanaged key")
+
+    def test_plain_key_passes_through_when_idle(self):
+        self.assertTrue(K3.press())
+        smtd.wait(10)
+        self.assertTrue(K3.release())
+        smtd.wait(500)
+
+        self.assertHistory()
+        self.assertNoUnmanagedActions()
+
+    def test_managed_key_is_processed(self):
+        self.assertFalse(K1.press())
+        smtd.wait(10)
+        self.assertFalse(K1.release())
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_plain_key_is_queued_behind_pending_key(self):
+        K1.press()
+        smtd.wait(10)
+        self.assertFalse(K3.press())
+        smtd.wait(10)
+        self.assertFalse(K3.release())
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K3, mods=MOD_LSFT),
+            released(K3, mods=MOD_LSFT),
+        )
+        self.assertNoUnmanagedActions()
+
+    def test_roll_over_plain_key_stays_taps(self):
+        K1.press()
+        smtd.wait(50)
+        K3.press()
+        smtd.wait(50)
+        K1.release()
+        smtd.wait(50)
+        K3.release()
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+            pressed(K3),
+            released(K3),
+        )
+        self.assertNoUnmanagedActions()
+
+    def test_release_of_passed_key_while_pending(self):
+        self.assertTrue(K3.press())
+        smtd.wait(10)
+        K1.press()
+        smtd.wait(10)
+        self.assertTrue(K3.release())
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+    def test_plain_key_after_sequence_ends(self):
+        K1.press()
+        smtd.wait(10)
+        K1.release()
+        smtd.wait(500)
+
+        self.assertTrue(K3.press())
+        self.assertTrue(K3.release())
+        self.assertHistory(
+            pressed(K1),
+            released(K1),
+        )
+
+
+all_keycodes = [Keycode(smtd, 100 + col, 0, col, 0) for col in range(9)] + \
+               [Keycode(smtd, 200 + col, 0, col, 1) for col in range(9)]
+
+K1 = Key(smtd, 'K1', 0, 1, "SMTD_MT(L0_KC1, KC_LSFT)", all_keycodes)
+K2 = Key(smtd, 'K2', 0, 2, "SMTD_MT(L0_KC2, KC_LCTL)", all_keycodes)
+K3 = Key(smtd, 'K3', 0, 3, "plain, unmanaged", all_keycodes)
+
+all_keys = [K1, K2, K3]
+
+
+def reset():
+    for keycode in all_keycodes:
+        keycode.reset()
+    for key in all_keys:
+        key.reset()
+    smtd.reset()
+    smtd.lib.TEST_reset_unmanaged_actions()
+
+
+if __name__ == "__main__":
+    unittest.main()